@@ -0,0 +1,1010 @@
+/**
+ * Per-phase benchmark of dcc
+ * Generates a DummyC program with dcgen (or reads the given file) and
+ * times lexing, parsing, simplification of the AST, flattening, code
+ * generation (from the tree and from FlatAST), the pass manager, code
+ * generation building SSA directly and the teardown of the front end
+ * separately. The memory of both AST representations and the variable
+ * lookups of codegen are reported too. The IR built directly in SSA is
+ * checked against the IR after mem2reg, and dcbench fails if they
+ * differ. Every phase reports throughput and heap allocations as JSON.
+ *
+ * usage: dcbench [options] [file.dc]
+ *   -functions N    functions in the generated program (default 100)
+ *   -statements N   statements per function (default 20)
+ *   -depth N        operators per expression (default 8)
+ *   -identifiers N  local variables per function (default 8)
+ *   -seed N         seed of the generator (default 1)
+ *   -n N            repeat count, the fastest run is reported (default 5)
+ *   -o file         write JSON to file instead of stdout
+ *   -dump file      write the generated source to file
+ *   -scaling N      time only the parser on adversarial programs of
+ *                   N, 2N, 4N and 8N units; linear if ns/token stays flat
+ *   -chain N        time all phases on one expression of N chained
+ *                   operators (stack safety, e.g. -chain 1000000)
+ *   -threads N      threads parsing function bodies (default 1)
+ *   -no-simplify    generate code from the AST as parsed
+ *   -eval-budget N  steps to evaluate a pure call at compile time
+ *                   (default DefaultEvalBudget, 0 disables)
+ *   -link-lib N     time linking a program calling one function of a
+ *                   runtime library of N generated functions, given as
+ *                   LLVM IR and as bitcode (read lazily)
+ *   -opt-levels     for each of -O0 to -O3, time the pass pipeline, the
+ *                   lazy JIT compilation of main and its run time instead;
+ *                   the simplifier already folds most of a generated
+ *                   program, so combine with -no-simplify to see what
+ *                   the pipelines buy
+ *   -interp         time to the first printnum and to the end of main of
+ *                   the bytecode interpreter and of the lazy JIT, both
+ *                   from the source text (e.g. dcbench -interp
+ *                   sample/test.dc); the setup of the LLVM target is
+ *                   reported apart, as it is paid once per process
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/PassManager.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Transforms/Scalar.h"
+#include "dcgen.hpp"
+#include "heap.hpp"
+#include "lexer.hpp"
+#include "AST.hpp"
+#include "ASTVisitor.hpp"
+#include "ASTSimplifier.hpp"
+#include "FlatAST.hpp"
+#include "parser.hpp"
+#include "codegen.hpp"
+#include "optimizer.hpp"
+#include "interpreter.hpp"
+
+
+/**
+ * Result of one phase
+ */
+typedef struct PhaseResult{
+    const char *Name;
+    const char *Unit;       //What Items counts
+    double Seconds;
+    long Items;
+    size_t Allocs;
+    size_t AllocBytes;
+}PhaseResult;
+
+
+/**
+ * Measure a phase between start() and stop()
+ */
+class PhaseTimer{
+    private:
+        std::chrono::steady_clock::time_point Start;
+        HeapStats Before;
+
+    public:
+        void start(){
+            Before = getHeapStats();
+            Start = std::chrono::steady_clock::now();
+        }
+        void stop(PhaseResult &res, bool first){
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - Start;
+            HeapStats after = getHeapStats();
+            if (first || elapsed.count() < res.Seconds){
+                res.Seconds = elapsed.count();
+                res.Allocs = after.AllocCount - Before.AllocCount;
+                res.AllocBytes = after.AllocBytes - Before.AllocBytes;
+            }
+        }
+};
+
+
+/**
+ * Count nodes of an expression tree
+ * The result of each node is the size of its subtree
+ */
+class NodeCounter : public PostOrderVisitor<NodeCounter, long>{
+    friend class ASTVisitor<NodeCounter, bool, llvm::ArrayRef<long>, long&>;
+
+    private:
+        static long sum(llvm::ArrayRef<long> operands){
+            long num = 1;
+            for (int i=0; i<operands.size(); i++)
+                num += operands[i];
+            return num;
+        }
+
+        bool visitVariableDecl(VariableDeclAST*, llvm::ArrayRef<long>, long &num){
+            num = 1;
+            return true;
+        }
+        bool visitBinaryExpr(BinaryExprAST *bin_expr, llvm::ArrayRef<long> operands, long &num){
+            //LHS of "=" is not an operand
+            num = sum(operands) + (bin_expr->getOp() == "=" ? 1 : 0);
+            return true;
+        }
+        bool visitNullExpr(NullExprAST*, llvm::ArrayRef<long>, long &num){
+            num = 1;
+            return true;
+        }
+        bool visitCallExpr(CallExprAST*, llvm::ArrayRef<long> operands, long &num){
+            num = sum(operands);
+            return true;
+        }
+        bool visitJumpStmt(JumpStmtAST*, llvm::ArrayRef<long> operands, long &num){
+            num = sum(operands);
+            return true;
+        }
+        bool visitVariable(VariableAST*, llvm::ArrayRef<long>, long &num){
+            num = 1;
+            return true;
+        }
+        bool visitNumber(NumberAST*, llvm::ArrayRef<long>, long &num){
+            num = 1;
+            return true;
+        }
+};
+
+
+/**
+ * Count nodes of the AST
+ */
+static long countNodes(TranslationUnitAST &tunit){
+    NodeCounter counter;
+    long num = 0;
+
+    for (int i=0; tunit.getPrototype(i); i++)
+        num++;
+
+    for (int i=0; tunit.getFunction(i); i++){
+        FunctionStmtAST *body = tunit.getFunction(i)->getBody();
+        num += 3;   //Function, Prototype, FunctionStmt
+        for (int j=0; body->getVariableDecl(j); j++)
+            num++;
+        long stmt_num;
+        for (int j=0; body->getStatement(j); j++){
+            if (counter.walk(body->getStatement(j), stmt_num))
+                num += stmt_num;
+        }
+    }
+    return num;
+}
+
+
+/**
+ * Count IR instructions of the module
+ */
+static long countInstructions(llvm::Module &mod){
+    long num = 0;
+    for (llvm::Module::iterator func = mod.begin(); func != mod.end(); ++func){
+        for (llvm::Function::iterator bb = func->begin(); bb != func->end(); ++bb)
+            num += bb->size();
+    }
+    return num;
+}
+
+
+/**
+ * Text of the module with constants folded and values unnamed
+ * CodeGen in SSA mode folds constant operands when it builds them and
+ * numbers the names differently, so the IR of the two modes is compared
+ * in this form
+ */
+static std::string getCanonicalIR(llvm::Module &mod){
+    llvm::PassManager pm;
+    pm.add(llvm::createConstantPropagationPass());
+    pm.run(mod);
+
+    for (llvm::Module::iterator func = mod.begin(); func != mod.end(); ++func){
+        for (llvm::Function::arg_iterator arg = func->arg_begin(); arg != func->arg_end(); ++arg)
+            arg->setName("");
+        for (llvm::Function::iterator bb = func->begin(); bb != func->end(); ++bb){
+            for (llvm::BasicBlock::iterator inst = bb->begin(); inst != bb->end(); ++inst)
+                inst->setName("");
+        }
+    }
+
+    std::string text;
+    llvm::raw_string_ostream stream(text);
+    mod.print(stream, NULL);
+    return stream.str();
+}
+
+
+/**
+ * Phases in the order they run
+ */
+enum PhaseIndex{
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_SIMPLIFY,
+    PHASE_FLATTEN,
+    PHASE_CODEGEN,
+    PHASE_CODEGEN_FLAT,
+    PHASE_PASSES,
+    PHASE_CODEGEN_SSA,
+    PHASE_TEARDOWN,
+    NUM_PHASES
+};
+
+/**
+ * Memory held by the two AST representations
+ */
+typedef struct ASTMemory{
+    long Tokens;
+    size_t TreeBytes;   //Arena of TranslationUnitAST
+    size_t FlatBytes;   //Arrays of FlatAST
+}ASTMemory;
+
+/**
+ * Variable accesses of the codegen phase
+ * Each is a lookup in VariableSlots by declaration; CodeGen used to look
+ * the alloca up by name in the ValueSymbolTable instead, and to build a
+ * "<name>_arg" string for each parameter
+ */
+typedef struct CodeGenLookups{
+    long SlotLookups;       //References and assignments found by declaration
+    long ArgumentStores;    //Parameters stored without a "<name>_arg" lookup
+}CodeGenLookups;
+
+
+/**
+ * Run all phases once
+ * @return success: true fail: false
+ */
+static bool runPhases(const std::string &source, int threads, bool simplify, long eval_budget,
+        std::vector<PhaseResult> &results, ASTMemory &memory, CodeGenLookups &lookups, bool first){
+    PhaseTimer timer;
+    StringInterner *symbols = new StringInterner();
+    std::unique_ptr<llvm::MemoryBuffer> buffer(
+            llvm::MemoryBuffer::getMemBufferCopy(source, "dcbench.dc"));
+
+    //Lexer
+    timer.start();
+    TokenStream *tokens = LexicalAnalysisBuffer(buffer.release(), symbols);
+    timer.stop(results[PHASE_LEX], first);
+    if (!tokens){
+        SAFE_DELETE(symbols);
+        return false;
+    }
+    results[PHASE_LEX].Items = tokens->getNumTokens();
+
+    //Parser
+    Parser *parser = new Parser(tokens, symbols);
+    parser->setThreads(threads);
+    timer.start();
+    bool parsed = parser->doParser();
+    timer.stop(results[PHASE_PARSE], first);
+    if (!parsed){
+        SAFE_DELETE(parser);
+        return false;
+    }
+    TranslationUnitAST &tunit = parser->getAST();
+    results[PHASE_PARSE].Items = countNodes(tunit);
+
+    //Simplifier (ast_nodes after it, parse has the count before)
+    if (simplify){
+        timer.start();
+        bool simplified = simplifyAST(tunit, eval_budget);
+        timer.stop(results[PHASE_SIMPLIFY], first);
+        if (!simplified){
+            SAFE_DELETE(parser);
+            return false;
+        }
+        results[PHASE_SIMPLIFY].Items = countNodes(tunit);
+    }
+
+    //FlatAST
+    timer.start();
+    FlatAST *flat = flattenAST(tunit);
+    timer.stop(results[PHASE_FLATTEN], first);
+    if (!flat){
+        SAFE_DELETE(parser);
+        return false;
+    }
+    results[PHASE_FLATTEN].Items = flat->getNumNodes();
+    memory.Tokens = results[PHASE_LEX].Items;
+    memory.TreeBytes = tunit.getArenaSize();
+    memory.FlatBytes = flat->getMemoryUsage();
+
+    //CodeGen from FlatAST
+    CodeGen *codegen = new CodeGen();
+    timer.start();
+    bool generated = codegen->doCodeGen(*flat, "dcbench", "", false);
+    timer.stop(results[PHASE_CODEGEN_FLAT], first);
+    if (generated)
+        results[PHASE_CODEGEN_FLAT].Items = countInstructions(codegen->getModule());
+    SAFE_DELETE(codegen);
+    SAFE_DELETE(flat);
+    if (!generated){
+        SAFE_DELETE(parser);
+        return false;
+    }
+
+    //CodeGen
+    codegen = new CodeGen();
+    timer.start();
+    generated = codegen->doCodeGen(tunit, "dcbench", "", false);
+    timer.stop(results[PHASE_CODEGEN], first);
+    if (!generated){
+        SAFE_DELETE(parser);
+        SAFE_DELETE(codegen);
+        return false;
+    }
+    llvm::Module &mod = codegen->getModule();
+    results[PHASE_CODEGEN].Items = countInstructions(mod);
+    lookups.SlotLookups = codegen->getSlotLookups();
+    lookups.ArgumentStores = codegen->getArgumentStores();
+
+    //Pass pipeline (dcc -O0)
+    Optimizer optimizer;
+    timer.start();
+    optimizer.run(mod);
+    timer.stop(results[PHASE_PASSES], first);
+    results[PHASE_PASSES].Items = countInstructions(mod);
+
+    //CodeGen building SSA directly
+    CodeGen *ssa_codegen = new CodeGen();
+    ssa_codegen->setSSA(true);
+    timer.start();
+    generated = ssa_codegen->doCodeGen(tunit, "dcbench", "", false);
+    timer.stop(results[PHASE_CODEGEN_SSA], first);
+    if (generated){
+        results[PHASE_CODEGEN_SSA].Items = countInstructions(ssa_codegen->getModule());
+        if (first && getCanonicalIR(mod) != getCanonicalIR(ssa_codegen->getModule())){
+            fprintf(stderr, "dcbench: IR of -ssa differs from IR after mem2reg\n");
+            generated = false;
+        }
+    }
+    SAFE_DELETE(ssa_codegen);
+    SAFE_DELETE(codegen);
+    if (!generated){
+        SAFE_DELETE(parser);
+        return false;
+    }
+
+    //Teardown of the AST and the TokenStream
+    timer.start();
+    SAFE_DELETE(parser);
+    timer.stop(results[PHASE_TEARDOWN], first);
+    results[PHASE_TEARDOWN].Items = results[PHASE_PARSE].Items;
+    return true;
+}
+
+
+/**
+ * Time the parser on adversarial programs of doubling size
+ * @return success: true fail: false
+ */
+static bool runScaling(FILE *out, int units, int repeat){
+    static const int NumSteps = 4;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"repeat\": %d,\n", repeat);
+    fprintf(out, "  \"scaling\": [\n");
+    for (int step=0; step<NumSteps; step++){
+        std::string source = generateAdversarialProgram(units << step);
+        double best = 0;
+        int num_tokens = 0;
+
+        for (int r=0; r<repeat; r++){
+            StringInterner *symbols = new StringInterner();
+            std::unique_ptr<llvm::MemoryBuffer> buffer(
+                    llvm::MemoryBuffer::getMemBufferCopy(source, "dcbench.dc"));
+            TokenStream *tokens = LexicalAnalysisBuffer(buffer.release(), symbols);
+            if (!tokens){
+                SAFE_DELETE(symbols);
+                return false;
+            }
+            num_tokens = tokens->getNumTokens();
+
+            Parser *parser = new Parser(tokens, symbols);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            bool parsed = parser->doParser();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            SAFE_DELETE(parser);
+            if (!parsed)
+                return false;
+            if (r == 0 || elapsed.count() < best)
+                best = elapsed.count();
+        }
+
+        fprintf(out, "    {\"units\": %d, \"bytes\": %zu, \"tokens\": %d, \"seconds\": %.6f, \"ns_per_token\": %.2f}%s\n",
+                units << step, source.size(), num_tokens, best,
+                best * 1e9 / num_tokens, step + 1 < NumSteps ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+    return true;
+}
+
+
+/**
+ * Lex and parse source
+ * @return success: Parser fail: NULL
+ */
+static Parser *parseSource(const std::string &source){
+    StringInterner *symbols = new StringInterner();
+    std::unique_ptr<llvm::MemoryBuffer> buffer(
+            llvm::MemoryBuffer::getMemBufferCopy(source, "dcbench.dc"));
+    TokenStream *tokens = LexicalAnalysisBuffer(buffer.release(), symbols);
+    if (!tokens){
+        SAFE_DELETE(symbols);
+        return NULL;
+    }
+    Parser *parser = new Parser(tokens, symbols);
+    if (!parser->doParser()){
+        SAFE_DELETE(parser);
+        return NULL;
+    }
+    return parser;
+}
+
+/**
+ * Count functions with a body
+ */
+static long countDefinitions(llvm::Module &mod){
+    long num = 0;
+    for (llvm::Module::iterator func = mod.begin(); func != mod.end(); ++func){
+        if (!func->isDeclaration())
+            num++;
+    }
+    return num;
+}
+
+/**
+ * Write mod to a temporary file as LLVM IR or bitcode
+ * @return success: true (file name in path, time in seconds) fail: false
+ */
+static bool writeLibrary(llvm::Module &mod, bool bitcode, std::string &path, double &seconds){
+    int fd;
+    llvm::SmallString<128> file_name;
+    if (llvm::sys::fs::createTemporaryFile("dcbench", bitcode ? "bc" : "ll", fd, file_name))
+        return false;
+    path = file_name.str();
+
+    llvm::raw_fd_ostream stream(fd, true);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (bitcode)
+        llvm::WriteBitcodeToFile(&mod, stream);
+    else
+        mod.print(stream, NULL);
+    stream.close();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    seconds = elapsed.count();
+    return true;
+}
+
+/**
+ * Time dcc -l with a runtime library of lib_functions generated
+ * functions, as LLVM IR and as bitcode. The program calls f3 only, which
+ * reaches f0 to f3 through the calls dcgen generates
+ * @return success: true fail: false
+ */
+static bool runLinkBench(FILE *out, GenOptions opt, int lib_functions, int repeat){
+    static const char *Client =
+        "int f3(int a, int b);\n"
+        "int main(){\n"
+        "    printnum(f3(1, 2));\n"
+        "    return 0;\n"
+        "}\n";
+
+    //Library: a generated program whose main is renamed
+    opt.Functions = lib_functions;
+    Parser *parser = parseSource(generateProgram(opt));
+    if (!parser)
+        return false;
+    CodeGen *lib_codegen = new CodeGen();
+    bool generated = lib_codegen->doCodeGen(parser->getAST(), "runtime", "", false);
+    SAFE_DELETE(parser);
+    if (!generated){
+        SAFE_DELETE(lib_codegen);
+        return false;
+    }
+    llvm::Module &lib = lib_codegen->getModule();
+    Optimizer optimizer;
+    optimizer.run(lib);
+    lib.getFunction("main")->setName("runtime_main");
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"repeat\": %d,\n", repeat);
+    fprintf(out, "  \"library_functions\": %ld,\n", countDefinitions(lib));
+    fprintf(out, "  \"formats\": [\n");
+    for (int bitcode=0; bitcode<2; bitcode++){
+        std::string path;
+        double write_seconds;
+        if (!writeLibrary(lib, bitcode, path, write_seconds)){
+            SAFE_DELETE(lib_codegen);
+            return false;
+        }
+        uint64_t bytes = 0;
+        llvm::sys::fs::file_size(path, bytes);
+
+        double best = 0;
+        long linked = 0;
+        for (int r=0; r<repeat; r++){
+            parser = parseSource(Client);
+            if (!parser)
+                break;
+            CodeGen *codegen = new CodeGen();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            generated = codegen->doCodeGen(parser->getAST(), "client", path, false);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (generated)
+                linked = countDefinitions(codegen->getModule());
+            SAFE_DELETE(codegen);
+            SAFE_DELETE(parser);
+            if (!generated)
+                break;
+            if (r == 0 || elapsed.count() < best)
+                best = elapsed.count();
+        }
+        llvm::sys::fs::remove(path);
+        if (!generated){
+            SAFE_DELETE(lib_codegen);
+            return false;
+        }
+
+        fprintf(out, "    {\"format\": \"%s\", \"bytes\": %llu, \"write_seconds\": %.6f, "
+                "\"link_seconds\": %.6f, \"functions_linked\": %ld}%s\n",
+                bitcode ? "bitcode" : "ir", (unsigned long long)bytes, write_seconds,
+                best, linked, bitcode ? "" : ",");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+    SAFE_DELETE(lib_codegen);
+    return true;
+}
+
+/**
+ * printnum of the programs run by -opt-levels, without output
+ */
+static int silentPrintnum(int value){
+    return value;
+}
+
+/**
+ * Time the pipelines of -O0 to -O3: the passes, the JIT compilation of
+ * main alone (startup), with its first call, which compiles the callees
+ * as dcc -jit does, and the calls of main after it
+ * @return success: true fail: false
+ */
+static bool runOptLevels(FILE *out, const std::string &source, bool simplify, long eval_budget, int repeat){
+    static const int RunCalls = 100000;
+
+    llvm::sys::DynamicLibrary::AddSymbol("printnum", (void*)silentPrintnum);
+    fprintf(out, "{\n");
+    fprintf(out, "  \"repeat\": %d,\n", repeat);
+    fprintf(out, "  \"run_calls\": %d,\n", RunCalls);
+    fprintf(out, "  \"opt_levels\": [\n");
+    for (int level=0; level<=MaxOptLevel; level++){
+        Optimizer optimizer;
+        optimizer.setOptLevel(level);
+        double opt_best = 0, startup_best = 0, jit_best = 0, run_best = 0;
+        long num_insts = 0;
+
+        for (int r=0; r<repeat; r++){
+            Parser *parser = parseSource(source);
+            if (!parser)
+                return false;
+            if (simplify && !simplifyAST(parser->getAST(), eval_budget)){
+                SAFE_DELETE(parser);
+                return false;
+            }
+            CodeGen *codegen = new CodeGen();
+            bool generated = codegen->doCodeGen(parser->getAST(), "dcbench", "", false);
+            SAFE_DELETE(parser);
+            llvm::Module &mod = codegen->getModule();
+            llvm::Function *main_func = generated ? mod.getFunction("main") : NULL;
+            if (!main_func){
+                SAFE_DELETE(codegen);
+                return false;
+            }
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            optimizer.run(mod);
+            std::chrono::duration<double> opt_time = std::chrono::steady_clock::now() - start;
+            num_insts = countInstructions(mod);
+
+            std::string error;
+            llvm::ExecutionEngine *engine = llvm::EngineBuilder(&mod)
+                .setEngineKind(llvm::EngineKind::JIT)
+                .setErrorStr(&error)
+                .create();
+            if (!engine){
+                fprintf(stderr, "dcbench: %s\n", error.c_str());
+                SAFE_DELETE(codegen);
+                return false;
+            }
+            engine->DisableLazyCompilation(false);
+            start = std::chrono::steady_clock::now();
+            int (*fp)() = (int (*)())engine->getPointerToFunction(main_func);
+            std::chrono::duration<double> startup_time = std::chrono::steady_clock::now() - start;
+            fp();
+            std::chrono::duration<double> jit_time = std::chrono::steady_clock::now() - start;
+
+            start = std::chrono::steady_clock::now();
+            for (int i=0; i<RunCalls; i++)
+                fp();
+            std::chrono::duration<double> run_time = std::chrono::steady_clock::now() - start;
+
+            //The module stays with CodeGen
+            engine->removeModule(&mod);
+            SAFE_DELETE(engine);
+            SAFE_DELETE(codegen);
+
+            if (r == 0 || opt_time.count() < opt_best)
+                opt_best = opt_time.count();
+            if (r == 0 || startup_time.count() < startup_best)
+                startup_best = startup_time.count();
+            if (r == 0 || jit_time.count() < jit_best)
+                jit_best = jit_time.count();
+            if (r == 0 || run_time.count() < run_best)
+                run_best = run_time.count();
+        }
+
+        fprintf(out, "    {\"level\": %d, \"passes\": \"%s\", \"opt_seconds\": %.6f, \"ir_instructions\": %ld, "
+                "\"startup_seconds\": %.6f, \"jit_seconds\": %.6f, \"run_ns_per_call\": %.1f}%s\n",
+                level, optimizer.getPipeline().c_str(), opt_best, num_insts,
+                startup_best, jit_best, run_best * 1e9 / RunCalls, level < MaxOptLevel ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+    return true;
+}
+
+
+/**
+ * Time of the first printnum of -interp
+ */
+static bool Printed;
+static std::chrono::steady_clock::time_point FirstOutput;
+
+/**
+ * printnum of the programs run by -interp, recording the first call
+ */
+static int stampPrintnum(int value){
+    if (!Printed){
+        FirstOutput = std::chrono::steady_clock::now();
+        Printed = true;
+    }
+    return value;
+}
+
+static int stampBuiltin(const int *args, int){
+    return stampPrintnum(args[0]);
+}
+
+/**
+ * Time from the source text to the first printnum and to the end of main
+ * on the interpreter (parse, lower, run) and on the lazy JIT (parse,
+ * codegen, -O0 pipeline, JIT), as dcc -interp and dcc -jit run
+ * A program without printnum counts its end as its first output
+ * @return success: true fail: false
+ */
+static bool runFirstOutput(FILE *out, const std::string &source, bool simplify, long eval_budget, int repeat){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    llvm::InitializeNativeTarget();
+    std::chrono::duration<double> init_time = std::chrono::steady_clock::now() - start;
+    llvm::sys::DynamicLibrary::AddSymbol("printnum", (void*)stampPrintnum);
+
+    double interp_first = 0, interp_total = 0, jit_first = 0, jit_total = 0;
+    size_t num_bytecodes = 0;
+    long num_insts = 0;
+    for (int r=0; r<repeat; r++){
+        //Interpreter
+        Printed = false;
+        start = std::chrono::steady_clock::now();
+        Parser *parser = parseSource(source);
+        if (!parser)
+            return false;
+        if (simplify && !simplifyAST(parser->getAST(), eval_budget)){
+            SAFE_DELETE(parser);
+            return false;
+        }
+        Interpreter interp;
+        interp.addBuiltin(SYM_PRINTNUM, stampBuiltin);
+        int result;
+        if (!interp.load(parser->getAST()) || !interp.run(result)){
+            SAFE_DELETE(parser);
+            return false;
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        std::chrono::duration<double> first_time = (Printed ? FirstOutput : end) - start;
+        std::chrono::duration<double> total_time = end - start;
+        if (r == 0 || first_time.count() < interp_first)
+            interp_first = first_time.count();
+        if (r == 0 || total_time.count() < interp_total)
+            interp_total = total_time.count();
+        num_bytecodes = interp.getNumInstructions();
+        SAFE_DELETE(parser);
+
+        //Lazy JIT
+        Printed = false;
+        start = std::chrono::steady_clock::now();
+        parser = parseSource(source);
+        if (!parser)
+            return false;
+        if (simplify && !simplifyAST(parser->getAST(), eval_budget)){
+            SAFE_DELETE(parser);
+            return false;
+        }
+        CodeGen *codegen = new CodeGen();
+        bool generated = codegen->doCodeGen(parser->getAST(), "dcbench", "", false);
+        SAFE_DELETE(parser);
+        llvm::Module &mod = codegen->getModule();
+        llvm::Function *main_func = generated ? mod.getFunction("main") : NULL;
+        if (!main_func){
+            SAFE_DELETE(codegen);
+            return false;
+        }
+        Optimizer optimizer;
+        optimizer.run(mod);
+
+        std::string error;
+        llvm::ExecutionEngine *engine = llvm::EngineBuilder(&mod)
+            .setEngineKind(llvm::EngineKind::JIT)
+            .setErrorStr(&error)
+            .create();
+        if (!engine){
+            fprintf(stderr, "dcbench: %s\n", error.c_str());
+            SAFE_DELETE(codegen);
+            return false;
+        }
+        engine->DisableLazyCompilation(false);
+        int (*fp)() = (int (*)())engine->getPointerToFunction(main_func);
+        fp();
+        end = std::chrono::steady_clock::now();
+        first_time = (Printed ? FirstOutput : end) - start;
+        total_time = end - start;
+        if (r == 0 || first_time.count() < jit_first)
+            jit_first = first_time.count();
+        if (r == 0 || total_time.count() < jit_total)
+            jit_total = total_time.count();
+        num_insts = countInstructions(mod);
+
+        //The module stays with CodeGen
+        engine->removeModule(&mod);
+        SAFE_DELETE(engine);
+        SAFE_DELETE(codegen);
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"repeat\": %d,\n", repeat);
+    fprintf(out, "  \"llvm_init_seconds\": %.6f,\n", init_time.count());
+    fprintf(out, "  \"interp\": {\"first_output_seconds\": %.6f, \"total_seconds\": %.6f, \"bytecode_instructions\": %zu},\n",
+            interp_first, interp_total, num_bytecodes);
+    fprintf(out, "  \"jit\": {\"first_output_seconds\": %.6f, \"total_seconds\": %.6f, \"ir_instructions\": %ld}\n",
+            jit_first, jit_total, num_insts);
+    fprintf(out, "}\n");
+    return true;
+}
+
+
+/**
+ * Write results as JSON
+ */
+static void writeJSON(FILE *out, const GenOptions &opt, const std::string &input,
+        int chain, int threads, size_t bytes, int repeat, std::vector<PhaseResult> &results, ASTMemory &memory,
+        CodeGenLookups &lookups){
+    fprintf(out, "{\n");
+    fprintf(out, "  \"input\": {\n");
+    if (chain > 0){
+        fprintf(out, "    \"generated\": true,\n");
+        fprintf(out, "    \"chain_operators\": %d,\n", chain);
+    }else if (input.empty()){
+        fprintf(out, "    \"generated\": true,\n");
+        fprintf(out, "    \"functions\": %d,\n", opt.Functions);
+        fprintf(out, "    \"statements\": %d,\n", opt.Statements);
+        fprintf(out, "    \"expr_depth\": %d,\n", opt.ExprDepth);
+        fprintf(out, "    \"identifiers\": %d,\n", opt.Identifiers);
+        fprintf(out, "    \"seed\": %u,\n", opt.Seed);
+    }else{
+        fprintf(out, "    \"generated\": false,\n");
+        fprintf(out, "    \"file\": \"%s\",\n", input.c_str());
+    }
+    fprintf(out, "    \"bytes\": %zu\n", bytes);
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"repeat\": %d,\n", repeat);
+    fprintf(out, "  \"threads\": %d,\n", threads);
+    fprintf(out, "  \"ast_memory\": {\n");
+    fprintf(out, "    \"tree_bytes\": %zu,\n", memory.TreeBytes);
+    fprintf(out, "    \"flat_bytes\": %zu,\n", memory.FlatBytes);
+    fprintf(out, "    \"tree_bytes_per_token\": %.2f,\n", (double)memory.TreeBytes / memory.Tokens);
+    fprintf(out, "    \"flat_bytes_per_token\": %.2f\n", (double)memory.FlatBytes / memory.Tokens);
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"codegen_lookups\": {\n");
+    fprintf(out, "    \"slot_lookups\": %ld,\n", lookups.SlotLookups);
+    fprintf(out, "    \"argument_stores\": %ld,\n", lookups.ArgumentStores);
+    fprintf(out, "    \"name_lookups_removed\": %ld,\n", lookups.SlotLookups + lookups.ArgumentStores);
+    fprintf(out, "    \"name_strings_removed\": %ld\n", lookups.ArgumentStores);
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"phases\": {\n");
+    for (int i=0; i<results.size(); i++){
+        PhaseResult &res = results[i];
+        fprintf(out, "    \"%s\": {\n", res.Name);
+        fprintf(out, "      \"seconds\": %.6f,\n", res.Seconds);
+        fprintf(out, "      \"%s\": %ld,\n", res.Unit, res.Items);
+        fprintf(out, "      \"%s_per_sec\": %.1f,\n", res.Unit,
+                res.Seconds > 0 ? res.Items / res.Seconds : 0.0);
+        fprintf(out, "      \"allocs\": %zu,\n", res.Allocs);
+        fprintf(out, "      \"alloc_bytes\": %zu\n", res.AllocBytes);
+        fprintf(out, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
+}
+
+
+/**
+ * main function
+ */
+int main(int argc, char **argv){
+    GenOptions opt;
+    int repeat = 5;
+    int scaling = 0;
+    int chain = 0;
+    int threads = 1;
+    bool simplify = true;
+    bool opt_levels = false;
+    bool interp = false;
+    int link_lib = 0;
+    long eval_budget = DefaultEvalBudget;
+    std::string input;
+    std::string output;
+    std::string dump;
+
+    for (int i=1; i<argc; i++){
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "-functions") == 0 && has_value){
+            opt.Functions = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-statements") == 0 && has_value){
+            opt.Statements = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-depth") == 0 && has_value){
+            opt.ExprDepth = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-identifiers") == 0 && has_value){
+            opt.Identifiers = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-seed") == 0 && has_value){
+            opt.Seed = strtoul(argv[++i], NULL, 10);
+        }else if (strcmp(argv[i], "-n") == 0 && has_value){
+            repeat = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-scaling") == 0 && has_value){
+            scaling = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-chain") == 0 && has_value){
+            chain = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-threads") == 0 && has_value){
+            threads = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-no-simplify") == 0){
+            simplify = false;
+        }else if (strcmp(argv[i], "-eval-budget") == 0 && has_value){
+            eval_budget = atol(argv[++i]);
+        }else if (strcmp(argv[i], "-link-lib") == 0 && has_value){
+            link_lib = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-opt-levels") == 0){
+            opt_levels = true;
+        }else if (strcmp(argv[i], "-interp") == 0){
+            interp = true;
+        }else if (strcmp(argv[i], "-o") == 0 && has_value){
+            output = argv[++i];
+        }else if (strcmp(argv[i], "-dump") == 0 && has_value){
+            dump = argv[++i];
+        }else if (argv[i][0] == '-'){
+            fprintf(stderr, "%s is unknown option\n", argv[i]);
+            return 1;
+        }else{
+            input = argv[i];
+        }
+    }
+
+    FILE *out = output.empty() ? stdout : fopen(output.c_str(), "w");
+    if (!out){
+        fprintf(stderr, "cannot open %s\n", output.c_str());
+        return 1;
+    }
+
+    //Parser scaling on adversarial inputs
+    if (scaling > 0){
+        bool success = runScaling(out, scaling, repeat);
+        if (out != stdout)
+            fclose(out);
+        if (!success){
+            fprintf(stderr, "dcbench: parsing failed\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    //Link time of a runtime library as LLVM IR and as bitcode
+    if (link_lib > 0){
+        bool success = runLinkBench(out, opt, link_lib, repeat);
+        if (out != stdout)
+            fclose(out);
+        if (!success){
+            fprintf(stderr, "dcbench: linking failed\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    //Source
+    std::string source;
+    if (chain > 0){
+        source = generateChainProgram(chain);
+    }else if (input.empty()){
+        source = generateProgram(opt);
+    }else{
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer> > buffer =
+            llvm::MemoryBuffer::getFile(input);
+        if (!buffer){
+            fprintf(stderr, "cannot read %s\n", input.c_str());
+            return 1;
+        }
+        source = buffer.get()->getBuffer().str();
+    }
+    if (!dump.empty()){
+        FILE *fp = fopen(dump.c_str(), "w");
+        if (fp){
+            fputs(source.c_str(), fp);
+            fclose(fp);
+        }
+    }
+
+    //Compile time and run time of each -O level
+    if (opt_levels){
+        llvm::InitializeNativeTarget();
+        bool success = runOptLevels(out, source, simplify, eval_budget, repeat);
+        if (out != stdout)
+            fclose(out);
+        if (!success){
+            fprintf(stderr, "dcbench: compilation failed\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    //Time to the first output of the interpreter and of the JIT
+    if (interp){
+        bool success = runFirstOutput(out, source, simplify, eval_budget, repeat);
+        if (out != stdout)
+            fclose(out);
+        if (!success){
+            fprintf(stderr, "dcbench: running failed\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    PhaseResult phases[NUM_PHASES] = {
+        {"lex", "tokens", 0, 0, 0, 0},
+        {"parse", "ast_nodes", 0, 0, 0, 0},
+        {"simplify", "ast_nodes", 0, 0, 0, 0},
+        {"flatten", "flat_nodes", 0, 0, 0, 0},
+        {"codegen", "ir_instructions", 0, 0, 0, 0},
+        {"codegen_flat", "ir_instructions", 0, 0, 0, 0},
+        {"passes", "ir_instructions", 0, 0, 0, 0},
+        {"codegen_ssa", "ir_instructions", 0, 0, 0, 0},
+        {"teardown", "ast_nodes", 0, 0, 0, 0}
+    };
+    std::vector<PhaseResult> results(phases, phases + NUM_PHASES);
+    ASTMemory memory;
+    CodeGenLookups lookups;
+
+    for (int r=0; r<repeat; r++){
+        if (!runPhases(source, threads, simplify, eval_budget, results, memory, lookups, r == 0)){
+            fprintf(stderr, "dcbench: compilation failed\n");
+            return 1;
+        }
+    }
+
+    writeJSON(out, opt, input, chain, threads, source.size(), repeat, results, memory, lookups);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
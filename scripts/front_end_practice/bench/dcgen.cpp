@@ -0,0 +1,250 @@
+#include <cstdio>
+#include "dcgen.hpp"
+
+/**
+ * Generator of synthetic DummyC sources
+ * Every function fN(a, b) declares its locals, initializes them, runs
+ * Statements assignments and returns a local. A function calls at most
+ * one earlier function, so running main stays linear in program size.
+ * Division is only done by non-zero constants.
+ */
+class ProgramGenerator{
+    private:
+        GenOptions Opt;
+        unsigned Seed;
+        std::string Out;
+        int CurFunc;
+        bool CallUsed;
+
+    public:
+        ProgramGenerator(const GenOptions &opt): Opt(opt), Seed(opt.Seed){}
+        std::string generate();
+
+    private:
+        unsigned random(unsigned n);
+        void generateFunction(int index);
+        void generateExpression(int depth);
+        void generateLeaf();
+        void appendInt(int value);
+        void appendName(char prefix, int index);
+};
+
+
+/**
+ * Linear congruential generator, same sequence on every host
+ */
+unsigned ProgramGenerator::random(unsigned n){
+    Seed = Seed * 1103515245 + 12345;
+    return (Seed >> 16) % n;
+}
+
+void ProgramGenerator::appendInt(int value){
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", value);
+    Out += buf;
+}
+
+void ProgramGenerator::appendName(char prefix, int index){
+    Out += prefix;
+    appendInt(index);
+}
+
+/**
+ * Variable, parameter, number or call of the previous function
+ */
+void ProgramGenerator::generateLeaf(){
+    int num_vars = Opt.Identifiers > 0 ? Opt.Identifiers : 1;
+    switch (random(8)){
+        case 0:
+            Out += random(2) ? "a" : "b";
+            break;
+        case 1:
+            appendInt(random(1000));
+            break;
+        case 2:
+            Out += "-";
+            appendInt(random(100) + 1);
+            break;
+        case 3:
+            if (CurFunc > 0 && !CallUsed){
+                CallUsed = true;
+                appendName('f', CurFunc - 1);
+                Out += "(a, ";
+                appendName('v', random(num_vars));
+                Out += ")";
+                break;
+            }
+            //fall through
+        default:
+            appendName('v', random(num_vars));
+            break;
+    }
+}
+
+/**
+ * Expression with depth operators
+ * The spine nests to the left, with parenthesized right operands
+ */
+void ProgramGenerator::generateExpression(int depth){
+    if (depth <= 0){
+        generateLeaf();
+        return;
+    }
+
+    static const char *ops[] = {" + ", " - ", " * ", " / "};
+    int op = random(4);
+    if (random(4) == 0){
+        generateLeaf();
+        Out += ops[op == 3 ? 0 : op];
+        Out += "(";
+        generateExpression(depth - 1);
+        Out += ")";
+    }else{
+        generateExpression(depth - 1);
+        Out += ops[op];
+        if (op == 3)
+            appendInt(random(9) + 1);
+        else
+            generateLeaf();
+    }
+}
+
+void ProgramGenerator::generateFunction(int index){
+    int num_vars = Opt.Identifiers > 0 ? Opt.Identifiers : 1;
+    CurFunc = index;
+    CallUsed = false;
+
+    Out += "int ";
+    appendName('f', index);
+    Out += "(int a, int b){\n";
+    for (int i=0; i<num_vars; i++){
+        Out += "    int ";
+        appendName('v', i);
+        Out += ";\n";
+    }
+    for (int i=0; i<num_vars; i++){
+        Out += "    ";
+        appendName('v', i);
+        Out += " = ";
+        appendInt(i);
+        Out += ";\n";
+    }
+    for (int i=0; i<Opt.Statements; i++){
+        Out += "    ";
+        appendName('v', random(num_vars));
+        Out += " = ";
+        generateExpression(Opt.ExprDepth);
+        Out += ";\n";
+    }
+    Out += "    return ";
+    appendName('v', random(num_vars));
+    Out += ";\n}\n\n";
+}
+
+std::string ProgramGenerator::generate(){
+    Out.clear();
+    Out += "// generated by dcgen\n";
+    for (int i=0; i<Opt.Functions; i++)
+        generateFunction(i);
+
+    Out += "int main(){\n";
+    if (Opt.Functions > 0){
+        Out += "    printnum(";
+        appendName('f', Opt.Functions - 1);
+        Out += "(1, 2));\n";
+    }
+    Out += "    return 0;\n}\n";
+    return Out;
+}
+
+
+/**
+ * Generate a DummyC program
+ * @param shape of the program
+ * @return source code
+ */
+std::string generateProgram(const GenOptions &opt){
+    ProgramGenerator gen(opt);
+    return gen.generate();
+}
+
+
+/**
+ * Generate a DummyC program made of the constructs a backtracking
+ * parser re-parses: prototypes followed by definitions, expression
+ * statements beginning with a variable, deep parentheses and nested calls.
+ * The size grows linearly with units.
+ * @param number of repeated blocks
+ * @return source code
+ */
+std::string generateAdversarialProgram(int units){
+    static const int NumParams = 16;
+    static const int ParenDepth = 32;
+    static const int CallDepth = 8;
+    std::string out = "// generated by dcgen (adversarial)\n";
+    char name[32];
+
+    for (int i=0; i<units; i++){
+        //Declaration and definition with a long parameter list
+        std::string params;
+        for (int j=0; j<NumParams; j++){
+            snprintf(name, sizeof(name), "%sint p%d", j ? ", " : "", j);
+            params += name;
+        }
+        snprintf(name, sizeof(name), "int g%d(", i);
+        out += name + params + ");\n";
+        out += name + params + "){\n    return p0 + p15;\n}\n";
+
+        //Function whose statements start like assignments
+        snprintf(name, sizeof(name), "h%d", i);
+        std::string func = name;
+        out += "int " + func + "(int a, int b);\n";
+        out += "int " + func + "(int a, int b){\n    int v;\n";
+        out += "    a + b * a - b;\n";
+        out += "    v = " + std::string(ParenDepth, '(') + "a + b" + std::string(ParenDepth, ')') + ";\n";
+        if (i > 0){
+            snprintf(name, sizeof(name), "h%d(", i - 1);
+            out += "    v = ";
+            for (int j=0; j<CallDepth; j++)
+                out += name;
+            out += "a";
+            for (int j=0; j<CallDepth; j++)
+                out += ", b)";
+            out += ";\n";
+        }
+        out += "    return v;\n}\n";
+    }
+
+    out += "int main(){\n    return 0;\n}\n";
+    return out;
+}
+
+
+/**
+ * Generate a DummyC program whose main returns one expression of
+ * operators chained binary operators (a left leaning tree as deep as
+ * the chain is long). Additive and multiplicative operators alternate,
+ * division is only done by non-zero constants.
+ * @param number of operators
+ * @return source code
+ */
+std::string generateChainProgram(int operators){
+    static const char *ops[] = {" + ", " * ", " - ", " / "};
+    std::string out = "// generated by dcgen (chain)\n";
+    out += "int main(){\n    int x;\n    x = 1;\n    return x";
+    char num[16];
+
+    for (int i=0; i<operators; i++){
+        out += ops[i % 4];
+        if (i % 4 == 3){
+            snprintf(num, sizeof(num), "%d", i % 7 + 1);
+            out += num;
+        }else{
+            out += "x";
+        }
+        if (i % 32 == 31)
+            out += "\n        ";
+    }
+    out += ";\n}\n";
+    return out;
+}
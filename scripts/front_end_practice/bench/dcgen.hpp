@@ -0,0 +1,24 @@
+#ifndef DCGEN_HPP
+#define DCGEN_HPP
+
+#include <string>
+
+/**
+ * Shape of a generated DummyC program
+ */
+typedef struct GenOptions{
+    int Functions;      //Number of functions besides main
+    int Statements;     //Assignment statements per function
+    int ExprDepth;      //Operators in the expression of each statement
+    int Identifiers;    //Local variables per function
+    unsigned Seed;
+
+    GenOptions(): Functions(100), Statements(20), ExprDepth(8),
+        Identifiers(8), Seed(1){}
+}GenOptions;
+
+std::string generateProgram(const GenOptions &opt);
+std::string generateAdversarialProgram(int units);
+std::string generateChainProgram(int operators);
+
+#endif
@@ -0,0 +1,52 @@
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <new>
+#include "heap.hpp"
+
+/**
+ * Every allocation carries its size in a header so live bytes can be tracked
+ * The counters are atomic as the Parser allocates on worker threads with
+ * -threads; relaxed order is enough for counting
+ */
+static std::atomic<size_t> AllocCount(0);
+static std::atomic<size_t> AllocBytes(0);
+static std::atomic<size_t> LiveBytes(0);
+static const size_t AllocHeader = 16;
+
+void *operator new(size_t size){
+    char *p = (char*)malloc(size + AllocHeader);
+    if (!p){
+        fprintf(stderr, "out of memory\n");
+        abort();
+    }
+    *(size_t*)p = size;
+    AllocCount.fetch_add(1, std::memory_order_relaxed);
+    AllocBytes.fetch_add(size, std::memory_order_relaxed);
+    LiveBytes.fetch_add(size, std::memory_order_relaxed);
+    return p + AllocHeader;
+}
+
+void operator delete(void *ptr) noexcept{
+    if (!ptr)
+        return;
+    char *p = (char*)ptr - AllocHeader;
+    LiveBytes.fetch_sub(*(size_t*)p, std::memory_order_relaxed);
+    free(p);
+}
+
+void *operator new[](size_t size){return operator new(size);}
+void operator delete[](void *ptr) noexcept{operator delete(ptr);}
+void operator delete(void *ptr, size_t) noexcept{operator delete(ptr);}
+void operator delete[](void *ptr, size_t) noexcept{operator delete(ptr);}
+
+/**
+ * Get a snapshot of the heap counters
+ */
+HeapStats getHeapStats(){
+    HeapStats stats;
+    stats.AllocCount = AllocCount.load(std::memory_order_relaxed);
+    stats.AllocBytes = AllocBytes.load(std::memory_order_relaxed);
+    stats.LiveBytes = LiveBytes.load(std::memory_order_relaxed);
+    return stats;
+}
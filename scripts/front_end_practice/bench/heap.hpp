@@ -0,0 +1,18 @@
+#ifndef HEAP_HPP
+#define HEAP_HPP
+
+#include <cstddef>
+
+/**
+ * Heap accounting of the benchmarks
+ * Linking heap.cpp replaces the global operator new/delete
+ */
+typedef struct HeapStats{
+    size_t AllocCount;      //Number of allocations so far
+    size_t AllocBytes;      //Bytes allocated so far
+    size_t LiveBytes;       //Bytes allocated and not freed
+}HeapStats;
+
+HeapStats getHeapStats();
+
+#endif
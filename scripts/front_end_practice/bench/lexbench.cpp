@@ -0,0 +1,234 @@
+/**
+ * Lexer benchmark
+ * Lexes the given DummyC sources and reports tokens per second and
+ * the heap bytes the TokenStream retains per token.
+ *
+ * With -verify, every scanner implementation lexes the files and a set
+ * of random inputs, and the token sequences are compared.
+ *
+ * usage: lexbench [-n repeat] [-legacy] [-scan=mode] [-verify] file.dc ...
+ *   -n          number of times each file is lexed (default 5)
+ *   -legacy     use the getline lexer instead of the mapped one
+ *   -scan=mode  scanner of the mapped lexer: auto, scalar, sse2 or avx2
+ *   -verify     compare the scanners instead of timing
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "heap.hpp"
+#include "lexer.hpp"
+#include "scan.hpp"
+
+
+static StringInterner Symbols;
+
+
+/**
+ * Count tokens by walking the stream
+ */
+static int countTokens(TokenStream *tokens){
+    int num = 1;
+    tokens->applyTokenIndex(0);
+    while (tokens->getNextToken())
+        num++;
+    tokens->applyTokenIndex(0);
+    return num;
+}
+
+
+/**
+ * Lex text with the given scanner
+ */
+static TokenStream *lexText(const std::string &text, ScanMode mode){
+    setScanMode(mode);
+    std::unique_ptr<llvm::MemoryBuffer> buffer(llvm::MemoryBuffer::getMemBufferCopy(text));
+    return LexicalAnalysisBuffer(buffer.release(), &Symbols);
+}
+
+
+/**
+ * Compare two token sequences
+ * @return same: true differ: false
+ */
+static bool sameTokens(TokenStream *a, TokenStream *b){
+    if (!a || !b)
+        return !a && !b;
+
+    a->applyTokenIndex(0);
+    b->applyTokenIndex(0);
+    while (true){
+        if (a->getCurType() != b->getCurType() ||
+                a->getCurRef() != b->getCurRef() ||
+                a->getCurLine() != b->getCurLine() ||
+                a->getCurNumVal() != b->getCurNumVal()){
+            fprintf(stderr, "token %d differs : '%s' line %d / '%s' line %d\n",
+                    a->getCurIndex(), a->getCurString().c_str(), a->getCurLine(),
+                    b->getCurString().c_str(), b->getCurLine());
+            return false;
+        }
+        bool next_a = a->getNextToken();
+        bool next_b = b->getNextToken();
+        if (next_a != next_b)
+            return false;
+        if (!next_a)
+            return true;
+    }
+}
+
+
+/**
+ * Lex text with every supported scanner and compare against the scalar one
+ * @return same: true differ: false
+ */
+static bool verifyText(const std::string &text){
+    static const ScanMode modes[] = {SCAN_SSE2, SCAN_AVX2};
+    TokenStream *expect = lexText(text, SCAN_SCALAR);
+    bool same = true;
+
+    for (int i=0; same && i<sizeof(modes)/sizeof(modes[0]); i++){
+        if (!isScanModeSupported(modes[i]))
+            continue;
+        TokenStream *tokens = lexText(text, modes[i]);
+        if (!sameTokens(expect, tokens)){
+            fprintf(stderr, "%s scanner differs from scalar\n", getScanModeName(modes[i]));
+            same = false;
+        }
+        SAFE_DELETE(tokens);
+    }
+    SAFE_DELETE(expect);
+    return same;
+}
+
+
+/**
+ * Random input made of runs of every character class, so that class
+ * boundaries fall on every position of a 16/32 byte block
+ */
+static std::string randomText(unsigned &seed){
+    static const char *pieces[] = {
+        " ", "\t", "\n", "\r\n", "\v\f", "a", "Z9", "int", "return", "0", "7",
+        "/", "*", "/*", "*/", "//", "**/", "+", "-", "=", ";", ",", "(", ")", "{", "}"
+    };
+    static const char runs[] = {' ', '\n', 'q', '5', '*'};
+    std::string text;
+    int num = (seed = seed * 1103515245 + 12345) % 64;
+
+    for (int i=0; i<num; i++){
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 16) % 4 == 0){
+            text.append((seed >> 8) % 70, runs[(seed >> 20) % sizeof(runs)]);
+        }else{
+            text += pieces[(seed >> 16) % (sizeof(pieces) / sizeof(pieces[0]))];
+        }
+    }
+    return text;
+}
+
+
+/**
+ * main function
+ */
+int main(int argc, char **argv){
+    int repeat = 5;
+    bool legacy = false;
+    bool verify = false;
+    ScanMode mode = SCAN_AUTO;
+    int status = 0;
+    std::vector<std::string> files;
+
+    for (int i=1; i<argc; i++){
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+            repeat = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-legacy") == 0){
+            legacy = true;
+        }else if (strcmp(argv[i], "-verify") == 0){
+            verify = true;
+        }else if (strncmp(argv[i], "-scan=", 6) == 0){
+            std::string name = argv[i] + 6;
+            mode = name == "scalar" ? SCAN_SCALAR : name == "sse2" ? SCAN_SSE2 :
+                name == "avx2" ? SCAN_AVX2 : SCAN_AUTO;
+        }else if (argv[i][0] == '-'){
+            fprintf(stderr, "%s is unknown option\n", argv[i]);
+            return 1;
+        }else{
+            files.push_back(argv[i]);
+        }
+    }
+
+    //Differential check of the scanners
+    if (verify){
+        int num_random = 20000;
+        unsigned seed = 1;
+        for (int i=0; i<files.size(); i++){
+            llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer> > buffer =
+                llvm::MemoryBuffer::getFile(files[i]);
+            if (!buffer || !verifyText(buffer.get()->getBuffer().str())){
+                fprintf(stdout, "%s: FAILED\n", files[i].c_str());
+                status = 1;
+            }else{
+                fprintf(stdout, "%s: ok\n", files[i].c_str());
+            }
+        }
+        for (int i=0; i<num_random; i++){
+            std::string text = randomText(seed);
+            if (!verifyText(text)){
+                fprintf(stdout, "random input %d: FAILED\n%s\n", i, text.c_str());
+                status = 1;
+                break;
+            }
+        }
+        if (!status)
+            fprintf(stdout, "%d random inputs: ok\n", num_random);
+        return status;
+    }
+
+    if (!setScanMode(mode)){
+        fprintf(stderr, "%s scanner is not supported\n", getScanModeName(mode));
+        return 1;
+    }
+
+    for (int i=0; i<files.size(); i++){
+        std::string file_name = files[i];
+        double best = 0;
+        int num_tokens = 0;
+        size_t allocs = 0;
+        size_t retained = 0;
+        double file_size = 0;
+
+        for (int r=0; r<repeat; r++){
+            HeapStats before = getHeapStats();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            TokenStream *tokens = legacy ? LexicalAnalysis(file_name, &Symbols)
+                : LexicalAnalysisMapped(file_name, &Symbols);
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (!tokens){
+                fprintf(stderr, "error at lexer : %s\n", file_name.c_str());
+                status = 1;
+                break;
+            }
+            HeapStats after = getHeapStats();
+            allocs = after.AllocCount - before.AllocCount;
+            retained = after.LiveBytes - before.LiveBytes;
+            num_tokens = countTokens(tokens);
+            if (tokens->getSource())
+                file_size = tokens->getSource()->getBufferSize();
+            if (r == 0 || elapsed.count() < best)
+                best = elapsed.count();
+            SAFE_DELETE(tokens);
+        }
+        if (num_tokens == 0)
+            continue;
+
+        fprintf(stdout, "%s [%s]: %d tokens, %.1f Mtokens/s, %.1f MB/s, %.1f bytes/token, %.2f allocs/token\n",
+                file_name.c_str(), legacy ? "getline" : getScanModeName(getScanMode()),
+                num_tokens, num_tokens / best / 1e6, file_size / best / 1e6,
+                (double)retained / num_tokens, (double)allocs / num_tokens);
+    }
+
+    return status;
+}
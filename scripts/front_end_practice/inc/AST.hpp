@@ -2,11 +2,16 @@
 #define AST_HPP
 
 
+#include<memory>
 #include<string>
 #include<map>
 #include<vector>
+#include<llvm/ADT/ArrayRef.h>
+#include<llvm/ADT/StringRef.h>
+#include<llvm/Support/Allocator.h>
 #include<llvm/Support/Casting.h>
 #include"APP.hpp"
+#include"interner.hpp"
 
 /****************************************
  * AST
@@ -45,29 +50,60 @@ enum AstID{
 
 /**
  * Base class of AST
+ * Nodes are allocated from the arena of TranslationUnitAST and are
+ * never destroyed one by one, so they must be trivially destructible
+ * (no std::string or std::vector members, no virtual destructor)
  */
 class BaseAST{
     AstID ID;
 
     public:
         BaseAST(AstID id): ID(id){}
-        virtual ~BaseAST(){}
         AstID getValueID() const {return ID;}
 };
 
 /**
  * AST that represents source code
+ * Identifiers in the tree are SymbolIDs of Symbols
+ * Every node and its arrays live in Arena (or in an arena adopted from
+ * a parser thread), which is released at once when the TranslationUnit
+ * is deleted
+ * e.g. new (tunit->getAllocator()) NumberAST(1)
  */
 class TranslationUnitAST{
     std::vector<PrototypeAST*> Prototypes;
     std::vector<FunctionAST*> Functions;
+    StringInterner *Symbols;
+    llvm::BumpPtrAllocator Arena;
+    std::vector<llvm::BumpPtrAllocator*> AdoptedArenas;
 
     public:
-        TranslationUnitAST(){}
+        TranslationUnitAST(StringInterner *symbols): Symbols(symbols){}
         ~TranslationUnitAST();
         bool addPrototype(PrototypeAST *proto);
-        bool addFunction(FunctionAST *func));
+        bool addFunction(FunctionAST *func);
+        bool adoptAllocator(llvm::BumpPtrAllocator *arena);
         bool empty();
+        StringInterner *getSymbols(){return Symbols;}
+        llvm::BumpPtrAllocator &getAllocator(){return Arena;}
+        size_t getArenaSize();
+
+        /**
+         * Copy array into the arena
+         * @return ArrayRef valid as long as the arena
+         */
+        template<typename T>
+        static llvm::ArrayRef<T> copyArray(llvm::BumpPtrAllocator &arena, llvm::ArrayRef<T> array){
+            if (array.empty())
+                return llvm::ArrayRef<T>();
+            T *buf = arena.Allocate<T>(array.size());
+            std::uninitialized_copy(array.begin(), array.end(), buf);
+            return llvm::ArrayRef<T>(buf, array.size());
+        }
+        template<typename T>
+        llvm::ArrayRef<T> copyArray(llvm::ArrayRef<T> array){
+            return copyArray(Arena, array);
+        }
         PrototypeAST *getPrototype(int i){
             if (i < Prototypes.size()){
                 return Prototypes.at(i);
@@ -76,8 +112,8 @@ class TranslationUnitAST{
             }
         }
         FunctionAST *getFunction(int i){
-            if (i < prototypes.size()){
-                return Function.at(i);
+            if (i < Functions.size()){
+                return Functions.at(i);
             }else{
                 return NULL;
             }
@@ -89,17 +125,17 @@ class TranslationUnitAST{
  * AST that represents declaration of function
  */
 class PrototypeAST{
-    std::string Name;
-    std::vector<std::string> Params;
+    SymbolID Name;
+    llvm::ArrayRef<SymbolID> Params;
 
     public:
-        PrototypeAST(const std::string &name, const std::vector<std::string> &params)
+        PrototypeAST(SymbolID name, llvm::ArrayRef<SymbolID> params)
             : Name(name), Params(params){}
-        std::string getName(){return Name;}
-        std::string getParamName(int i){
+        SymbolID getName(){return Name;}
+        SymbolID getParamName(int i){
             if (i < Params.size())
-                return Params.at(i);
-            return NULL;
+                return Params[i];
+            return -1;
         }
         int getParamNum(){
             return Params.size();
@@ -114,8 +150,7 @@ class FunctionAST{
     FunctionStmtAST *Body;
     public:
         FunctionAST(PrototypeAST *proto, FunctionStmtAST *body): Proto(proto), Body(body){}
-        ~FunctionAST();
-        std::string getName(){
+        SymbolID getName(){
             return Proto->getName();
         }
         PrototypeAST *getPrototype(){
@@ -126,6 +161,34 @@ class FunctionAST{
         }
 };
 
+/**
+ * AST that represents function body
+ * Declarations and statements are arrays in the arena
+ */
+class FunctionStmtAST{
+    llvm::ArrayRef<VariableDeclAST*> VariableDecls;
+    llvm::ArrayRef<BaseAST*> StmtLists;
+
+    public:
+        FunctionStmtAST(llvm::ArrayRef<VariableDeclAST*> vdecls, llvm::ArrayRef<BaseAST*> stmts)
+            : VariableDecls(vdecls), StmtLists(stmts){}
+        VariableDeclAST *getVariableDecl(int i){
+            if (i < VariableDecls.size()){
+                return VariableDecls[i];
+            }else{
+                return NULL;
+            }
+        }
+        BaseAST *getStatement(int i){
+            if (i < StmtLists.size()){
+                return StmtLists[i];
+            }else{
+                return NULL;
+            }
+        }
+        bool setStatements(llvm::ArrayRef<BaseAST*> stmts){StmtLists = stmts; return true;}
+};
+
 /**
  * AST that represents declaration of variable
  */
@@ -137,36 +200,35 @@ class VariableDeclAST: public BaseAST {
         }DeclType;
 
     private:
-        std::string Name;
+        SymbolID Name;
         DeclType Type;
     public:
-        VariableDeclAST(const std::string &name): BaseAST(VariableDeclID), Name(name){}
+        VariableDeclAST(SymbolID name): BaseAST(VariableDeclID), Name(name){}
         static inline bool classof(VariableDeclAST const*){return true;}
         static inline bool classof(BaseAST const* base){
             return base->getValueID() == VariableDeclID;
         }
-        ~VariableDeclAST(){}
         bool setDeclType(DeclType type){Type = type; return true;};
-        std::string getName(){return Name;}
+        SymbolID getName(){return Name;}
         DeclType getType(){return Type;}
 };
 
 /**
  * AST that represents binary expression
+ * Op refers to a string literal
  */
 class BinaryExprAST : public BaseAST{
-    std::string Op;
+    llvm::StringRef Op;
     BaseAST *LHS, *RHS;
     public:
-    BinaryExprAST(std::string op, BaseAST *lhs, BaseAST *rhs)
+    BinaryExprAST(llvm::StringRef op, BaseAST *lhs, BaseAST *rhs)
         : BaseAST(BinaryExprID), Op(op), LHS(lhs), RHS(rhs){
         }
-    ~BinaryExprAST(){SAFE_DELETE(LHS); SAFE_DELETE(RHS);}
     static inline bool classof(BinaryExprAST const*){return true;}
     static inline bool classof(BaseAST const* base){
         return base->getValueID() == BinaryExprID;
     }
-    std::string getOp(){return Op;}
+    llvm::StringRef getOp(){return Op;}
     BaseAST *getLHS(){return LHS;}
     BaseAST *getRHS(){return RHS;}
 };
@@ -174,12 +236,12 @@ class BinaryExprAST : public BaseAST{
 /**
  * AST that represents ";"
  */
-class NullExprAST : BaseAST{
+class NullExprAST : public BaseAST{
     public:
         NullExprAST() : BaseAST(NullExprID){}
         static inline bool classof(NullExprAST const*){return true;}
-        static inline bool classof((BaseAST const* base){
-                return base->getValueID == NullExprID;        
+        static inline bool classof(BaseAST const* base){
+                return base->getValueID() == NullExprID;
         }
 };
 
@@ -187,24 +249,23 @@ class NullExprAST : BaseAST{
  * AST that represents function call
  */
 class CallExprAST : public BaseAST{
-    std::string Callee;
-    std::vector<BaseAST*> Args;
+    SymbolID Callee;
+    llvm::ArrayRef<BaseAST*> Args;
 
     public:
-    CallExprAST(const std::string &callee, std::vector<BaseAST*> &args)
+    CallExprAST(SymbolID callee, llvm::ArrayRef<BaseAST*> args)
         : BaseAST(CallExprID), Callee(callee), Args(args){}
-        ~CallExprAST();
-        std::string getCallee(){return Callee;}
+        SymbolID getCallee(){return Callee;}
         BaseAST *getArgs(int i){
             if (i < Args.size()){
-                return Args.at(i)
+                return Args[i];
             }else{
                 return NULL;
             }
         }
         static inline bool classof(CallExprAST const*){return true;}
         static inline bool classof(BaseAST const* base){
-            return base->getValueID == CallExprID;
+            return base->getValueID() == CallExprID;
         }
 };
 
@@ -216,7 +277,6 @@ class JumpStmtAST : public BaseAST{
     public:
         JumpStmtAST(BaseAST *expr) : BaseAST(JumpStmtID), Expr(expr){
         }
-        ~JumpStmtAST(){SAFE_DELETE(Expr);}
         BaseAST *getExpr(){return Expr;}
         static inline bool classof(JumpStmtAST const*){return true;}
         static inline bool classof(BaseAST const* base){
@@ -228,15 +288,16 @@ class JumpStmtAST : public BaseAST{
  * AST that represents variable refenrence
  */
 class VariableAST : public BaseAST{
-    std::string Name;
+    SymbolID Name;
+    VariableDeclAST *Decl;  //Declaration the name refers to
     public:
-        VariableAST(const std::string &name) : BaseAST(VariableID), Name(name){}
-        ~VariableAST(){}
+        VariableAST(SymbolID name, VariableDeclAST *decl) : BaseAST(VariableID), Name(name), Decl(decl){}
         static inline bool classof(VariableAST const*){return true;}
         static inline bool classof(BaseAST const* base){
             return base->getValueID() == VariableID;
         }
-        std::string getName(){return Name;}
+        SymbolID getName(){return Name;}
+        VariableDeclAST *getDecl(){return Decl;}
 };
 
 /**
@@ -246,12 +307,14 @@ class NumberAST : public BaseAST{
     int Val;
     public:
         NumberAST(int val) : BaseAST(NumberID), Val(val){};
-        ~NumberAST(){}
         int getNumberValue(){return Val;}
         static inline bool classof(NumberAST const*){return true;}
         static inline bool classof(BaseAST const* base){
-            return base->getValueID == NumberID;
+            return base->getValueID() == NumberID;
         }
 };
 
+
+BaseAST *getOperand(BaseAST *node, int i);
+
 #endif
@@ -0,0 +1,58 @@
+#ifndef AST_EVALUATOR_HPP
+#define AST_EVALUATOR_HPP
+
+#include<vector>
+#include<llvm/ADT/ArrayRef.h>
+#include<llvm/ADT/StringRef.h>
+#include"APP.hpp"
+#include"AST.hpp"
+
+/****************************************
+ * AST Evaluator
+ * *************************************/
+
+class FunctionEvaluator;
+
+/**
+ * Compile time evaluator of calls to pure functions
+ * A function is pure when it is defined and calls only pure functions;
+ * DummyC has no globals, so a call to a pure function depends on its
+ * arguments alone. printnum and any function declared but not defined
+ * are impure, and so is every function that can reach them.
+ * A call is evaluated by interpreting the AST within Budget steps (one
+ * per node); it fails, and is left to run time, when the budget runs
+ * out, a division would trap, a local is read before it is assigned or
+ * the function ends without return.
+ * As a body has no branch, the steps and the call depth of a function do
+ * not depend on its arguments, so a function that ran out of them once
+ * is not evaluated again.
+ */
+class ASTEvaluator{
+    private:
+        static const int MaxCallDepth = 256;
+
+        TranslationUnitAST *TU;
+        long Budget;                            //Steps allowed to one evaluateCall
+        long Steps;                             //Steps of the current evaluateCall
+        bool TooDeep;                           //Current evaluateCall exceeded MaxCallDepth
+        std::vector<FunctionAST*> Definitions;  //Functions indexed by SymbolID
+        std::vector<bool> Pure;                 //Purity indexed by SymbolID
+        std::vector<bool> TooCostly;            //Exceeded Budget or MaxCallDepth, by SymbolID
+        std::vector<FunctionEvaluator*> Frames; //Evaluator of each call depth
+
+    public:
+        ASTEvaluator(TranslationUnitAST &tunit, long budget);
+        ~ASTEvaluator();
+        bool isPure(SymbolID func){return func < Pure.size() && Pure[func];}
+        bool evaluateCall(SymbolID callee, llvm::ArrayRef<int> args, int &result);
+
+        bool step(){return ++Steps <= Budget;}
+        bool callFunction(SymbolID callee, llvm::ArrayRef<int> args, int depth, int &result);
+
+    private:
+        bool analyzePurity();
+};
+
+bool foldConstant(llvm::StringRef op, int lhs, int rhs, int &result);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef AST_SIMPLIFIER_HPP
+#define AST_SIMPLIFIER_HPP
+
+#include"APP.hpp"
+#include"AST.hpp"
+
+/****************************************
+ * AST Simplifier
+ * *************************************/
+
+/**
+ * Steps allowed to the evaluation of one call unless configured
+ */
+static const long DefaultEvalBudget = 100000;
+
+/**
+ * Fold constants and apply algebraic identities to the expressions of
+ * the TranslationUnit, between the parser and code generation.
+ * Arithmetic wraps at 32 bits like the add/sub/mul generated by CodeGen,
+ * a division is folded only when it cannot trap (divisor 0 or
+ * INT_MIN / -1), and a subexpression is dropped only when it has no call
+ * and no division.
+ * As a function body has no branch, a local assigned a constant is
+ * replaced by the constant until its next assignment.
+ * A call of a pure function with constant arguments is replaced by its
+ * value when ASTEvaluator computes it within eval_budget steps
+ * (0 disables the evaluation).
+ * Changed nodes are rebuilt in the arena of the TranslationUnit.
+ */
+bool simplifyAST(TranslationUnitAST &tunit, long eval_budget);
+
+#endif
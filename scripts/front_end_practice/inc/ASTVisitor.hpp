@@ -0,0 +1,113 @@
+#ifndef AST_VISITOR_HPP
+#define AST_VISITOR_HPP
+
+#include<vector>
+#include<llvm/ADT/ArrayRef.h>
+#include<llvm/Support/Casting.h>
+#include<llvm/Support/ErrorHandling.h>
+#include"AST.hpp"
+
+/****************************************
+ * AST Visitor
+ * *************************************/
+
+/**
+ * Visitor of AST nodes
+ * visit() dispatches on getValueID() with one switch to
+ * Derived::visitXxx(XxxAST*, args...). There is no default method and no
+ * default case, so a Derived class missing a kind does not compile and a
+ * new AstID without a case is reported by -Wswitch.
+ * e.g. class Printer : public ASTVisitor<Printer, bool>{ ... };
+ */
+template<typename Derived, typename RetTy=void, typename... ArgTys>
+class ASTVisitor{
+    public:
+        RetTy visit(BaseAST *node, ArgTys... args){
+            Derived *self = static_cast<Derived*>(this);
+            switch (node->getValueID()){
+                case VariableDeclID:
+                    return self->visitVariableDecl(llvm::cast<VariableDeclAST>(node), args...);
+                case BinaryExprID:
+                    return self->visitBinaryExpr(llvm::cast<BinaryExprAST>(node), args...);
+                case NullExprID:
+                    return self->visitNullExpr(llvm::cast<NullExprAST>(node), args...);
+                case CallExprID:
+                    return self->visitCallExpr(llvm::cast<CallExprAST>(node), args...);
+                case JumpStmtID:
+                    return self->visitJumpStmt(llvm::cast<JumpStmtAST>(node), args...);
+                case VariableID:
+                    return self->visitVariable(llvm::cast<VariableAST>(node), args...);
+                case NumberID:
+                    return self->visitNumber(llvm::cast<NumberAST>(node), args...);
+                case BaseID:
+                    break;
+            }
+            llvm_unreachable("BaseAST has no kind");
+        }
+};
+
+
+/**
+ * Post order walk of an expression (or statement) with an explicit stack,
+ * so the depth of the tree does not consume the C++ stack
+ * Derived::visitXxx(XxxAST *node, llvm::ArrayRef<ValueTy> operands, ValueTy &result)
+ * receives the results of the operands of node (see getOperand), sets the
+ * result of node (ValueTy() if it does not) and returns false to stop the
+ * walk.
+ * A Derived class declares the dispatcher a friend to keep its methods private:
+ * friend class ASTVisitor<Derived, bool, llvm::ArrayRef<ValueTy>, ValueTy&>;
+ */
+template<typename Derived, typename ValueTy>
+class PostOrderVisitor : public ASTVisitor<Derived, bool, llvm::ArrayRef<ValueTy>, ValueTy&>{
+    private:
+        /**
+         * Node being visited and the number of its operands done
+         */
+        typedef struct Frame{
+            BaseAST *Node;
+            int Next;
+        }Frame;
+
+        std::vector<Frame> Stack;
+        std::vector<ValueTy> Values;    //Results of the operands done
+
+    public:
+        /**
+         * Walk the tree rooted at root
+         * @return success: true (result of root in result) fail: false
+         */
+        bool walk(BaseAST *root, ValueTy &result){
+            Frame root_frame = {root, 0};
+            Stack.push_back(root_frame);
+            Values.clear();
+
+            while (!Stack.empty()){
+                Frame &frame = Stack.back();
+                BaseAST *operand = getOperand(frame.Node, frame.Next);
+                if (operand){
+                    frame.Next++;
+                    Frame operand_frame = {operand, 0};
+                    Stack.push_back(operand_frame);
+                    continue;
+                }
+
+                //All operands are done
+                BaseAST *node = frame.Node;
+                int num_operands = frame.Next;
+                Stack.pop_back();
+                llvm::ArrayRef<ValueTy> operands(
+                        Values.data() + Values.size() - num_operands, num_operands);
+                ValueTy value = ValueTy();
+                if (!this->visit(node, operands, value)){
+                    Stack.clear();
+                    return false;
+                }
+                Values.resize(Values.size() - num_operands);
+                Values.push_back(value);
+            }
+            result = Values.back();
+            return true;
+        }
+};
+
+#endif
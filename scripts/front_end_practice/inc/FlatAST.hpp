@@ -0,0 +1,119 @@
+#ifndef FLAT_AST_HPP
+#define FLAT_AST_HPP
+
+#include<stdint.h>
+#include<vector>
+#include<llvm/ADT/ArrayRef.h>
+#include"APP.hpp"
+#include"AST.hpp"
+
+/****************************************
+ * Flat AST
+ * *************************************/
+
+/**
+ * Opcode of flat node
+ * Operands A and B are node indices unless noted otherwise
+ */
+enum FlatOpcode{
+    FLAT_NUMBER,    //A: value
+    FLAT_VAR_LOAD,  //A: variable slot
+    FLAT_VAR_REF,   //A: variable slot (left side of assignment)
+    FLAT_ASSIGN,    //A: FLAT_VAR_REF node, B: value
+    FLAT_ADD,       //A: lhs, B: rhs
+    FLAT_SUB,
+    FLAT_MUL,
+    FLAT_DIV,
+    FLAT_CALL,      //A: callee SymbolID, B: offset of the argument list
+    FLAT_RETURN     //A: value
+};
+
+/**
+ * Function of flat AST
+ * Slots are the SymbolIDs of the parameters followed by the locals,
+ * a variable node refers to its declaration by slot number
+ */
+typedef struct FlatFunction{
+    SymbolID Name;
+    unsigned NumParams;
+    unsigned SlotBegin;
+    unsigned NumSlots;
+    unsigned NodeBegin;     //Body is [NodeBegin, NodeEnd)
+    unsigned NodeEnd;
+}FlatFunction;
+
+/**
+ * Compact AST
+ * Nodes are packed into parallel arrays (1 byte opcode and two 32 bit
+ * operands) in post order, so every child precedes its parent and the
+ * statements of a function follow each other in source order.
+ * Walking a function body from NodeBegin to NodeEnd visits expressions
+ * in evaluation order; no recursion is needed.
+ * NullExpr statements generate nothing and are not stored.
+ */
+class FlatAST{
+    private:
+        std::vector<uint8_t> Ops;
+        std::vector<uint32_t> OperandA;
+        std::vector<uint32_t> OperandB;
+        std::vector<uint32_t> ArgLists;     //Number of arguments followed by argument nodes
+        std::vector<SymbolID> Slots;
+        std::vector<FlatFunction> Prototypes;
+        std::vector<FlatFunction> Functions;
+        StringInterner *Symbols;
+
+    public:
+        FlatAST(StringInterner *symbols): Symbols(symbols){}
+        ~FlatAST(){}
+
+        StringInterner *getSymbols(){return Symbols;}
+        unsigned getNumNodes(){return Ops.size();}
+        FlatOpcode getOp(unsigned node){return (FlatOpcode)Ops[node];}
+        uint32_t getA(unsigned node){return OperandA[node];}
+        uint32_t getB(unsigned node){return OperandB[node];}
+        int getNumberValue(unsigned node){return (int)OperandA[node];}
+
+        /**
+         * Arguments of FLAT_CALL node
+         */
+        llvm::ArrayRef<uint32_t> getArgs(unsigned node){
+            const uint32_t *list = &ArgLists[OperandB[node]];
+            return llvm::ArrayRef<uint32_t>(list + 1, list[0]);
+        }
+
+        int getNumPrototypes(){return Prototypes.size();}
+        int getNumFunctions(){return Functions.size();}
+        FlatFunction &getPrototype(int i){return Prototypes[i];}
+        FlatFunction &getFunction(int i){return Functions[i];}
+        llvm::ArrayRef<SymbolID> getSlots(const FlatFunction &func){
+            return llvm::ArrayRef<SymbolID>(Slots.data() + func.SlotBegin, func.NumSlots);
+        }
+        llvm::ArrayRef<SymbolID> getParams(const FlatFunction &func){
+            return getSlots(func).slice(0, func.NumParams);
+        }
+
+        size_t getMemoryUsage();
+        bool shrinkToFit();
+
+        /**
+         * Methods used by the builder
+         */
+        uint32_t addNode(FlatOpcode op, uint32_t a, uint32_t b){
+            Ops.push_back(op);
+            OperandA.push_back(a);
+            OperandB.push_back(b);
+            return Ops.size() - 1;
+        }
+        uint32_t addArgList(llvm::ArrayRef<uint32_t> args);
+        unsigned addSlot(SymbolID name){
+            Slots.push_back(name);
+            return Slots.size() - 1;
+        }
+        unsigned getNumSlots(){return Slots.size();}
+        bool addPrototype(const FlatFunction &proto){Prototypes.push_back(proto); return true;}
+        bool addFunction(const FlatFunction &func){Functions.push_back(func); return true;}
+};
+
+FlatAST *flattenAST(TranslationUnitAST &tunit);
+
+#endif
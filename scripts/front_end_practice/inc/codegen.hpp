@@ -1,56 +1,111 @@
 #ifndef CODEGEN_HPP
 #define CODEGEN_HPP
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <map>
 #include <string>
 #include <vector>
 #include <llvm/ADT/APInt.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/JIT.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
 #include <llvm/Linker/Linker.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Metadata.h>
 #include <llvm/Support/Casting.h>
+#include <llvm/Support/Host.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IRReader/IRReader.h>
 #include <llvm/IR/MDBuilder.h>
-#include <llvm/IR/ValueSymbolTable.h>
 #include "APP.hpp"
 #include "AST.hpp"
+#include "ASTVisitor.hpp"
+#include "FlatAST.hpp"
+#include "optimizer.hpp"
+#include "speculator.hpp"
+#include "jitcache.hpp"
 
 
 /**
  * Code generation class
  */
-class CodeGen{
+class CodeGen : public PostOrderVisitor<CodeGen, llvm::Value*>{
+    friend class ASTVisitor<CodeGen, bool, llvm::ArrayRef<llvm::Value*>, llvm::Value*&>;
+
     private:
         llvm::Function *CurFunc;    //Function generating code currently
         llvm::Module *Mod;          //Module generated
         llvm::IRBuilder<> *Builder; //IRBuilder class for generating LLVM-IR
+        StringInterner *Symbols;    //Names of SymbolIDs in AST
+        std::vector<llvm::Function*> Functions;    //Functions indexed by SymbolID
+        llvm::DenseMap<VariableDeclAST*, llvm::AllocaInst*> VariableSlots; //Allocas of the function being generated
+        llvm::Function::arg_iterator NextArg;      //Argument stored to the next parameter
+        long SlotLookups;                          //References and assignments found in VariableSlots
+        long ArgumentStores;                       //Parameters stored from NextArg
+        bool SSA;                                  //Build SSA values directly instead of allocas
+        llvm::DenseMap<VariableDeclAST*, llvm::Value*> CurrentDefs; //Current value of each variable (SSA)
+        std::vector<llvm::AllocaInst*> FlatSlots;  //Variables of the FlatFunction being generated
+        std::vector<llvm::Value*> FlatValues;      //Values of its nodes
+        Optimizer *Opt;                            //Pipeline run before the module is used
+        SymbolID CurName;                          //Name of CurFunc
+        std::vector<std::pair<SymbolID, SymbolID> > CallEdges; //Caller and callee of each call
+        int JITThreads;                            //Threads compiling callees ahead (0: none)
+        JITObjectCache *JITCache;                  //Objects of MCJIT kept across runs
 
     public:
         CodeGen();
         ~CodeGen();
         bool doCodeGen(TranslationUnitAST &tunit, std::string name, std::string link_file, bool with_jit);
+        bool doCodeGen(FlatAST &flat, std::string name, std::string link_file, bool with_jit);
+        bool doFunctionCodeGen(TranslationUnitAST &tunit, llvm::ArrayRef<FunctionAST*> funcs, std::string name);
         llvm::Module &getModule();
+        bool setSSA(bool ssa){SSA = ssa; return true;}
+        bool setOptimizer(Optimizer *opt){Opt = opt; return true;}
+        bool setJITThreads(int threads){JITThreads = threads; return threads >= 0;}
+        bool setJITCache(JITObjectCache *cache){JITCache = cache; return true;}
+        long getSlotLookups(){return SlotLookups;}
+        long getArgumentStores(){return ArgumentStores;}
 
     private:
-        bool generateTranslationUnit(TranslationUnitAST &tunit, std:string name);
+        bool finishCodeGen(std::string link_file, bool with_jit);
+        bool runJIT();
+        bool generateTranslationUnit(TranslationUnitAST &tunit, std::string name);
+        bool generateFlatTranslationUnit(FlatAST &flat, std::string name);
+        llvm::Function *generateFlatFunction(FlatAST &flat, FlatFunction &func_info);
+        llvm::Function *declareFunction(SymbolID name, llvm::ArrayRef<SymbolID> params, llvm::Module *mod);
         llvm::Function *generateFunctionDefinition(FunctionAST *func, llvm::Module *mod);
         llvm::Function *generatePrototype(PrototypeAST *proto, llvm::Module *mod);
         llvm::Value *generateFunctionStatement(FunctionStmtAST *func_stmt);
         llvm::Value *generateVariableDeclaration(VariableDeclAST *vdecl);
         llvm::Value *generateStatement(BaseAST *stmt);
-        llvm::Value *generateBinaryExpression(BinaryExprAST *bin_expr);
-        llvm::Value *generateCallExpression(CallExpr *call_expr);
-        llvm::Value *generateJumpStatement(JumpStmtAST *jump_stmt);
+        llvm::Value *generateAssignment(BinaryExprAST *bin_expr, llvm::Value *rhs_v);
+        llvm::Value *generateBinaryExpression(BinaryExprAST *bin_expr, llvm::Value *lhs_v, llvm::Value *rhs_v);
+        llvm::Value *generateCallExpression(CallExprAST *call_expr, llvm::ArrayRef<llvm::Value*> args);
+        llvm::Value *generateJumpStatement(JumpStmtAST *jump_stmt, llvm::Value *ret_v);
         llvm::Value *generateVariable(VariableAST *var);
         llvm::Value *generateNumber(int value);
+        llvm::Function *getFunction(SymbolID name);
+        bool writeVariable(VariableDeclAST *vdecl, llvm::Value *value);
+        llvm::Value *readVariable(VariableDeclAST *vdecl);
         bool linkModule(llvm::Module *dest, std::string file_name);
+        bool materializeReferenced(llvm::Module *dest, llvm::Module *link_mod);
+        bool materializeConstant(llvm::Constant *constant, std::vector<llvm::Function*> &worklist,
+                llvm::DenseSet<llvm::Constant*> &visited);
+
+        bool visitVariableDecl(VariableDeclAST *vdecl, llvm::ArrayRef<llvm::Value*> operands, llvm::Value *&v);
+        bool visitBinaryExpr(BinaryExprAST *bin_expr, llvm::ArrayRef<llvm::Value*> operands, llvm::Value *&v);
+        bool visitNullExpr(NullExprAST *null_expr, llvm::ArrayRef<llvm::Value*> operands, llvm::Value *&v);
+        bool visitCallExpr(CallExprAST *call_expr, llvm::ArrayRef<llvm::Value*> operands, llvm::Value *&v);
+        bool visitJumpStmt(JumpStmtAST *jump_stmt, llvm::ArrayRef<llvm::Value*> operands, llvm::Value *&v);
+        bool visitVariable(VariableAST *var, llvm::ArrayRef<llvm::Value*> operands, llvm::Value *&v);
+        bool visitNumber(NumberAST *num, llvm::ArrayRef<llvm::Value*> operands, llvm::Value *&v);
 };
 
 #endif
@@ -0,0 +1,28 @@
+#ifndef EMITTER_HPP
+#define EMITTER_HPP
+
+#include <string>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+#include "APP.hpp"
+
+
+/**
+ * Native code emission through the TargetMachine of LLVM
+ * The module is compiled in process, so no llc has to parse the IR again.
+ * The target is the host unless -march selects another architecture;
+ * mcpu "native" tunes for the host CPU and enables its features.
+ */
+class NativeEmitter{
+    private:
+        llvm::TargetMachine *Machine;
+        std::string Triple;
+
+    public:
+        NativeEmitter(): Machine(NULL){}
+        ~NativeEmitter(){SAFE_DELETE(Machine);}
+        bool selectTarget(const std::string &march, const std::string &mcpu);
+        bool emit(llvm::Module &mod, const std::string &file_name, bool object);
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef INTERNER_HPP
+#define INTERNER_HPP
+
+#include<string>
+#include<vector>
+#include<llvm/ADT/StringMap.h>
+#include<llvm/ADT/StringRef.h>
+#include"APP.hpp"
+
+/**
+ * Dense ID of an interned identifier
+ */
+typedef int SymbolID;
+
+/**
+ * Symbols interned before lexing
+ */
+enum ReservedSymbol{
+    SYM_INT,
+    SYM_RETURN,
+    SYM_PRINTNUM,
+    SYM_PRINTNUM_PARAM,
+    NUM_RESERVED_SYMBOLS
+};
+
+/**
+ * Identifier interner
+ * Gives every distinct identifier an ID in [0, size())
+ * so later phases compare and index identifiers as integers
+ */
+class StringInterner{
+    private:
+        llvm::StringMap<SymbolID> Table;
+        std::vector<llvm::StringRef> Strings;   //Keys owned by Table
+
+    public:
+        StringInterner();
+        ~StringInterner(){}
+        SymbolID intern(llvm::StringRef str);
+        llvm::StringRef getString(SymbolID id){return Strings[id];}
+        std::string getName(SymbolID id){return Strings[id].str();}
+        int size(){return Strings.size();}
+};
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef INTERPRETER_HPP
+#define INTERPRETER_HPP
+
+#include<stdint.h>
+#include<atomic>
+#include<memory>
+#include<vector>
+#include"APP.hpp"
+#include"AST.hpp"
+
+/****************************************
+ * Bytecode Interpreter
+ * *************************************/
+
+/**
+ * Opcode of bytecode
+ * A, B and C are registers of the frame unless noted otherwise
+ */
+enum BytecodeOpcode{
+    BC_CONST,       //A = immediate (B and C)
+    BC_MOVE,        //A = B
+    BC_ADD,         //A = B + C
+    BC_SUB,
+    BC_MUL,
+    BC_DIV,
+    BC_CALL,        //A = call, immediate: offset of the call operands
+    BC_BUILTIN,     //A = call of a builtin, immediate: offset of the call operands
+    BC_RETURN,      //return A
+    NUM_BYTECODE_OPCODES
+};
+
+/**
+ * Instruction of 8 bytes
+ * BC_CONST, BC_CALL and BC_BUILTIN keep a 32 bit immediate in B (low
+ * half) and C (high half)
+ */
+typedef struct Instruction{
+    uint8_t Op;
+    uint16_t A;
+    uint16_t B;
+    uint16_t C;
+
+    uint32_t getImm() const {return B | (uint32_t)C << 16;}
+}Instruction;
+
+/**
+ * Function of bytecode
+ * Registers are the parameters, the locals and then the temporaries
+ */
+typedef struct BytecodeFunction{
+    SymbolID Name;
+    unsigned NumParams;
+    unsigned NumRegisters;
+    unsigned CodeBegin;
+}BytecodeFunction;
+
+/**
+ * Function implemented natively, called with the values of its arguments
+ */
+typedef int (*BuiltinFunction)(const int *args, int num_args);
+
+/**
+ * Native code of a function, called with the values of its arguments
+ */
+typedef int (*NativeFunction)(const int *args);
+
+/**
+ * Calls of a function before it is handed to the TierUpHandler
+ */
+static const unsigned DefaultTierUpThreshold = 1000;
+
+/**
+ * Receiver of the functions whose calls reach the threshold
+ * requestTierUp is called on the thread running the program, once per
+ * function, with the index of the function in the TranslationUnitAST
+ */
+class TierUpHandler{
+    public:
+        virtual ~TierUpHandler(){}
+        virtual bool requestTierUp(int func) = 0;
+};
+
+
+/**
+ * Interpreter running the TranslationUnitAST without LLVM
+ * load() lowers every function to a register bytecode: a variable is
+ * the register of its slot and the temporaries of an expression are
+ * allocated in the order of a stack, so a function needs as many
+ * registers as its variables plus the depth of its deepest expression.
+ * run() interprets main with threaded dispatch (computed goto where the
+ * compiler has it); calls push a frame instead of recursing, so the
+ * call depth does not consume the C++ stack.
+ * printnum is a builtin; addBuiltin() replaces it or adds others. A call
+ * of any other function declared but not defined fails to load.
+ * With setTierUp(), calls are counted per function and a function whose
+ * count reaches the threshold is handed to the TierUpHandler, which may
+ * compile it on another thread and install its code with setNative();
+ * the later calls of the function then run the native code.
+ */
+class Interpreter{
+    private:
+        static const unsigned MaxCallDepth = 1 << 16;
+        static const size_t MaxStackRegisters = 1 << 24;
+
+        /**
+         * Frame of a caller while its callee runs
+         */
+        typedef struct CallFrame{
+            const Instruction *ReturnPC;
+            size_t Base;
+            unsigned NumRegisters;
+            uint16_t ResultRegister;
+        }CallFrame;
+
+        std::vector<Instruction> Code;
+        std::vector<uint32_t> CallOperands;     //Callee, number of arguments, argument registers
+        std::vector<BytecodeFunction> Functions;
+        std::vector<BuiltinFunction> Builtins;
+        std::unique_ptr<std::atomic<NativeFunction>[]> Native;  //Native code by function index
+        std::vector<unsigned> CallCounts;
+        TierUpHandler *TierUp;
+        unsigned TierUpThreshold;
+        std::vector<int> FunctionOf;            //Function index by SymbolID (-1 if none)
+        std::vector<int> BuiltinOf;             //Builtin index by SymbolID (-1 if none)
+        int MainFunction;                       //Function index of main (-1 if none)
+        std::vector<int> Registers;
+        std::vector<CallFrame> Frames;
+        std::vector<int> Arguments;             //Arguments of builtin and native calls
+
+    public:
+        Interpreter();
+        ~Interpreter(){}
+        bool addBuiltin(SymbolID name, BuiltinFunction func);
+        bool load(TranslationUnitAST &tunit);
+        bool run(int &result);
+        size_t getNumInstructions(){return Code.size();}
+        bool setTierUp(TierUpHandler *handler, unsigned threshold);
+        bool setNative(int func, NativeFunction code);
+        bool getCallees(int func, std::vector<int> &callees);
+        BuiltinFunction getBuiltin(SymbolID name){
+            int index = getBuiltinIndex(name);
+            return index >= 0 ? Builtins[index] : NULL;
+        }
+        int getNumFunctions(){return Functions.size();}
+
+        /**
+         * Methods used by the builder
+         */
+        uint32_t addInstruction(BytecodeOpcode op, uint16_t a, uint16_t b, uint16_t c){
+            Instruction inst = {(uint8_t)op, a, b, c};
+            Code.push_back(inst);
+            return Code.size() - 1;
+        }
+        uint32_t addImmInstruction(BytecodeOpcode op, uint16_t a, uint32_t imm){
+            return addInstruction(op, a, imm & 0xffff, imm >> 16);
+        }
+        uint32_t addCallOperands(uint32_t callee, const std::vector<uint16_t> &args);
+        int getFunctionIndex(SymbolID name){
+            return name < FunctionOf.size() ? FunctionOf[name] : -1;
+        }
+        int getBuiltinIndex(SymbolID name){
+            return name < BuiltinOf.size() ? BuiltinOf[name] : -1;
+        }
+        unsigned getCodeSize(){return Code.size();}
+        BytecodeFunction &getFunction(int i){return Functions[i];}
+};
+
+#endif
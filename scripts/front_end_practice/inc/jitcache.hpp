@@ -0,0 +1,55 @@
+#ifndef JITCACHE_HPP
+#define JITCACHE_HPP
+
+#include <string>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include "APP.hpp"
+
+
+/**
+ * Size of the cache unless configured
+ */
+static const long DefaultJITCacheMegabytes = 64;
+
+/**
+ * Object files of MCJIT kept on disk across runs
+ * An object is stored as <hash>.o in the cache directory, the hash being
+ * the MD5 of the optimized IR and of the target (triple, CPU and its
+ * features), so that an unchanged program is loaded without running the
+ * backend. The key is taken by addModule before MCJIT compiles, as the
+ * backend changes the IR.
+ * When the objects exceed the size limit, the least recently used ones
+ * are removed. Hits, misses and evictions are counted in the file
+ * "stats" of the directory.
+ */
+class JITObjectCache : public llvm::ObjectCache{
+    private:
+        std::string Directory;
+        uint64_t MaxBytes;
+        llvm::DenseMap<const llvm::Module*, std::string> Keys;
+        long Hits;
+        long Misses;
+        long Evictions;
+
+    public:
+        JITObjectCache(const std::string &directory, uint64_t max_bytes);
+        ~JITObjectCache();
+        bool addModule(const llvm::Module *mod, llvm::StringRef target);
+        long getHits(){return Hits;}
+        long getMisses(){return Misses;}
+        long getEvictions(){return Evictions;}
+
+        virtual void notifyObjectCompiled(const llvm::Module *mod, const llvm::MemoryBuffer *obj);
+        virtual llvm::MemoryBuffer *getObject(const llvm::Module *mod);
+
+    private:
+        std::string getObjectPath(const std::string &key);
+        bool evict();
+        bool updateStats();
+};
+
+#endif
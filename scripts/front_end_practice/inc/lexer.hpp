@@ -2,12 +2,16 @@
 #define LEXER_HPP
 
 #include<cstdio>
-#include<cstddlib>
+#include<cstdlib>
+#include<cstring>
 #include<fstream>
 #include<list>
 #include<string>
 #include<vector>
+#include<llvm/ADT/StringRef.h>
+#include<llvm/Support/MemoryBuffer.h>
 #include"APP.hpp"
+#include"interner.hpp"
 
 /**
  * Token Type
@@ -23,32 +27,31 @@ enum TokenType{
 
 /**
  * Token Class
+ * Snapshot of one entry of TokenStream
+ * The string refers to the text held by TokenStream
  */
 typedef class Token{
     public:
 
     private:
         TokenType Type;
-        std::string TokenString;
+        llvm::StringRef TokenString;
         int Number;
         int Line;
 
     public:
-        Token(std::string string, TokenType type, int line)
-            : TokenString(string), Type(type), Line(line){
-                if(type == TOK_DIGIT)
-                    Number = atoi(string.c_str());
-                else
-                    Number = 0x7fffffff;
-            };
+        Token(TokenType type, llvm::StringRef string, int number, int line)
+            : Type(type), TokenString(string), Number(number), Line(line){};
         ~Token(){};
 
         TokenType getTokenType(){return Type;};
 
-        std::string getTokenString(){return TokenString;};
+        llvm::StringRef getTokenRef(){return TokenString;};
+
+        std::string getTokenString(){return TokenString.str();};
 
         int getNumberValue(){return Number;};
-        
+
         bool setLine(int line){Line=line; return true;};
 
         int getLine(){return Line;};
@@ -56,37 +59,119 @@ typedef class Token{
 }Token;
 
 
+/**
+ * Lexer state carried over buffer refills
+ */
+struct LexState{
+    int Line;
+    bool InBlockComment;
+    bool InLineComment;
+};
+
+
 /**
  * Token Stream
+ * Tokens are packed into parallel arrays indexed by token number.
+ * Offsets point into the mapped source, or into Text when the
+ * stream was not built from a mapped buffer.
+ * Values hold the value of a number, or the SymbolID of an identifier.
+ * In streaming mode tokens are lexed on demand from Input, and
+ * the arrays only hold the window from Base up to the last lexed token.
+ * A view shares the arrays and the text of another stream and only has
+ * its own CurIndex, so that threads can read one stream at once.
  */
 class TokenStream{
     public:
 
     private:
-        std::vector<Token*> Tokens;
+        /**
+         * Token arrays, shared with the views of the stream
+         */
+        typedef struct TokenArrays{
+            std::vector<unsigned char> Types;
+            std::vector<unsigned> Offsets;
+            std::vector<unsigned> Lengths;
+            std::vector<int> Lines;
+            std::vector<int> Values;
+        }TokenArrays;
+        TokenArrays OwnArrays;
+        TokenArrays *Arrays;            //&OwnArrays, or the arrays of the viewed stream
+        StringInterner *Symbols;        //Table identifiers are interned to
         int CurIndex;
+        int Base;                       //Token number of the first array entry
+        llvm::MemoryBuffer *Source;     //Mapped input referred by tokens
+        std::string Text;               //Token text owned by the stream
+        const char *SharedText;         //Token text of the viewed stream
+
+        //Streaming input
+        static const int StreamBufferSize = 64 * 1024;
+        static const int ReleaseThreshold = 4096;
+        bool Streaming;
+        bool HasError;
+        FILE *Input;
+        std::vector<char> Buffer;
+        int BufferPos;
+        int BufferLen;
+        LexState State;
 
     protected:
 
     public:
-        TokenStream(): CurIndex(0){}
+        TokenStream(StringInterner *symbols): Arrays(&OwnArrays), Symbols(symbols), CurIndex(0), Base(0),
+            Source(NULL), SharedText(NULL), Streaming(false), HasError(false), Input(NULL), BufferPos(0), BufferLen(0){
+            State.Line = 0;
+            State.InBlockComment = State.InLineComment = false;
+        }
         ~TokenStream();
 
         bool ungetToken(int Times=1);
         bool getNextToken();
-        bool pushToken(Token *token){
-            Tokens.push_back(token);
+        bool pushToken(TokenType type, llvm::StringRef string, int line, int value);
+        bool reserve(int num);
+        bool setSource(llvm::MemoryBuffer *source){
+            Source = source;
             return true;
         }
+        llvm::MemoryBuffer *getSource(){return Source;}
+        StringInterner *getSymbols(){return Symbols;}
+        bool setInput(FILE *input);
+        bool fill();
+        bool releaseTokens(int index);
+        bool hasError(){return HasError;}
+        bool isStreaming(){return Streaming;}
+        TokenStream *createView();
+        bool skipToSymbol(char symbol);
+        const char *getTextBase(){
+            if (SharedText)
+                return SharedText;
+            return Source ? Source->getBufferStart() : Text.data();
+        }
         Token getToken();
-        TokenType getCutType(){return Tokens[CurIndex]->getTokenType();}
-        std::string getCurString(){return Tokens[CurIndex]->getTokenString();}
-        int getCurNumVal(){return Tokens[CurIndex]->getNumberValue();}
+        Token peekToken();
+        TokenType getCurType(){return (TokenType)Arrays->Types[CurIndex - Base];}
+        llvm::StringRef getCurRef(){
+            int i = CurIndex - Base;
+            return llvm::StringRef(getTextBase() + Arrays->Offsets[i], Arrays->Lengths[i]);
+        }
+        std::string getCurString(){return getCurRef().str();}
+        int getCurNumVal(){return Arrays->Values[CurIndex - Base];}
+        SymbolID getCurSymbol(){return Arrays->Values[CurIndex - Base];}
+        int getCurLine(){return Arrays->Lines[CurIndex - Base];}
+        int getNumTokens(){return Base + Arrays->Types.size();}
+        size_t getMemoryUsage();
         bool printTokens();
         int getCurIndex(){return CurIndex;}
-        bool applyTokenIndex(int index){CurIndex=index; return true;}
+        bool applyTokenIndex(int index){
+            if (index < Base)
+                return false;
+            CurIndex=index;
+            return true;
+        }
 
 };
 
-TokenStream *LexicalAnalysis(std::string input_filename);
+TokenStream *LexicalAnalysis(std::string input_filename, StringInterner *symbols);
+TokenStream *LexicalAnalysisMapped(std::string input_filename, StringInterner *symbols);
+TokenStream *LexicalAnalysisBuffer(llvm::MemoryBuffer *buffer, StringInterner *symbols);
+TokenStream *LexicalAnalysisStream(std::string input_filename, StringInterner *symbols);
 #endif
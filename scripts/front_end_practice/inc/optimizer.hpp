@@ -0,0 +1,43 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Module.h>
+#include "APP.hpp"
+
+
+/**
+ * Highest level of -O
+ */
+static const int MaxOptLevel = 3;
+
+/**
+ * Pass pipeline run on the generated module
+ * A pipeline is a list of pass names; -O0 to -O3 select the curated
+ * ones, -passes= gives the list directly:
+ *   -O0  mem2reg
+ *   -O1  + early-cse, instcombine, sccp, dce and tailcallelim
+ *         (cheap cleanups within a function)
+ *   -O2  + inline, gvn, adce and globaldce
+ *   -O3  + ipsccp, deadargelim, reassociate and a higher inline threshold
+ * Every level starts with mem2reg, which setDirectSSA() drops when
+ * CodeGen builds SSA values itself.
+ */
+class Optimizer{
+    private:
+        std::vector<std::string> Passes;    //Names in the order they run
+
+    public:
+        Optimizer(){setOptLevel(0);}
+        bool setOptLevel(int level);
+        bool setPasses(llvm::StringRef list);
+        bool setDirectSSA(bool direct_ssa);
+        std::string getPipeline();
+        bool run(llvm::Module &mod);
+        static void printPassNames(FILE *out);
+};
+
+#endif
@@ -2,57 +2,137 @@
 #define PARSER_HPP
 
 #include <algorithm>
+#include <climits>
 #include <cstdio>
 #include <map>
 #include <string>
 #include <vector>
+#include <llvm/ADT/SmallVector.h>
 #include "APP.hpp"
 #include "AST.hpp"
 #include "lexer.hpp"
+#include "symtab.hpp"
 
 
+struct BodyQueue;
+
 /**
  * Class of parser and semantic analysis
+ * With more than one thread, external declarations are scanned first
+ * and function bodies are parsed afterwards on worker Parsers, each
+ * placing its nodes into its own arena
  */
 typedef class Parser{
     public:
 
     private:
+        /**
+         * Function body whose parsing is deferred
+         * Tokens [Begin, End] are '{' ... '}'
+         */
+        typedef struct BodyJob{
+            PrototypeAST *Proto;
+            int Begin;
+            int End;
+            int Position;
+            FunctionAST *Result;
+        }BodyJob;
+
+        Parser *Parent;                 //Parser owning the tables (worker Parser only)
+        StringInterner *Symbols;
         TokenStream *Tokens;
         TranslationUnitAST *TU;
+        llvm::BumpPtrAllocator *Arena;  //Allocator of TU, every node is placed in it
+
+        //Parentheses and call arguments are parsed recursively, so their
+        //nesting is limited to keep the C++ stack bounded
+        static const int MaxNestingDepth = 256;
+        int NestingDepth;
 
-        //Identifier table for semantic analysis
-        std::vector<std::string> VariableTable;
-        std::map<std::string, int> PrototypeTable;
-        std::map<std::string, int> FunctionTable;
+        //Threads parsing function bodies (1: parse them in place)
+        int Threads;
+        std::vector<BodyJob> BodyJobs;
+
+        //Number of the external declaration being parsed
+        int CurPosition;
+
+        //Declarations and statements of the function being parsed
+        std::vector<VariableDeclAST*> DeclBuffer;
+        std::vector<BaseAST*> StmtBuffer;
+
+        //Identifier tables for semantic analysis
+        //Variables are scoped by function, prototype and function tables
+        //hold the number of parameters indexed by SymbolID (-1 if not declared)
+        SymbolTable Variables;
+        std::vector<int> PrototypeTable;
+        std::vector<int> FunctionTable;
+        //Number of the first external declaration of a function (INT_MAX if
+        //not declared); it may be called from later declarations only
+        std::vector<int> VisibleFrom;
 
     protected:
 
     public:
-        Parser(std::string filename);
-        ~Parser(){SAFE_DELETE(TU); SAFE_DELETE(Tokens);}
+        Parser(std::string filename, bool streaming=false);
+        Parser(TokenStream *tokens, StringInterner *symbols);
+        ~Parser();
+        bool setThreads(int threads);
         bool doParser();
         TranslationUnitAST &getAST();
 
     private:
+        Parser(Parser *parent, llvm::BumpPtrAllocator *arena);
+
         /**
          * Methods of parsing
+         * Every method decides from the current token (and at most one
+         * token of lookahead) and never rewinds the TokenStream
          */
         bool visitTranslationUnit();
         bool visitExternalDeclaration(TranslationUnitAST *tunit);
-        PrototypeAST *visitFunctionDeclartion();
-        FunctionAST *vistFunctionDefinition();
+        PrototypeAST *visitFunctionDeclaration(PrototypeAST *proto);
+        FunctionAST *visitFunctionDefinition(PrototypeAST *proto);
+        bool checkFunctionDefinition(PrototypeAST *proto);
+        bool deferFunctionDefinition(PrototypeAST *proto);
+        bool parseFunctionBodies();
+        void runBodyWorker(BodyQueue *queue, llvm::BumpPtrAllocator *arena);
+        bool parseBodyChunk(BodyJob *first, BodyJob *last);
         PrototypeAST *visitPrototype();
         FunctionStmtAST *visitFunctionStatement(PrototypeAST *proto);
         VariableDeclAST *visitVariableDeclaration();
-        BaseAST *vistStatement();
+        BaseAST *visitStatement();
         BaseAST *visitExpressionStatement();
         BaseAST *visitJumpStatement();
         BaseAST *visitAssignmentExpression();
-        BaseAST *visitAdditiveExpression(BaseAST *lhs);
-        BaseAST *visitMultiplicationExpression(BaseAST *lhs);
+        BaseAST *visitBinaryExpression(int min_prec);
         BaseAST *visitPostfixExpression();
         BaseAST *visitPrimaryExpression();
+        BaseAST *visitNestedExpression();
+
+        /**
+         * Check whether the current token is the symbol
+         */
+        bool isSymbol(char symbol){
+            llvm::StringRef ref = Tokens->getCurRef();
+            return Tokens->getCurType() == TOK_SYMBOL && ref.size() == 1 && ref[0] == symbol;
+        }
+
+        /**
+         * Symbol tables
+         */
+        bool isVariable(SymbolID name){return Variables.lookup(name) != NULL;}
+        int lookupTable(std::vector<int> &table, SymbolID name);
+        bool setTable(std::vector<int> &table, SymbolID name, int param_num);
+        bool setVisible(SymbolID name);
+        int lookupCallee(SymbolID name);
+
+        /**
+         * Copy array into the arena of this Parser
+         */
+        template<typename T>
+        llvm::ArrayRef<T> copyArray(llvm::ArrayRef<T> array){
+            return TranslationUnitAST::copyArray(*Arena, array);
+        }
 
     protected:
 
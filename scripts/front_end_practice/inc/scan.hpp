@@ -0,0 +1,51 @@
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+/**
+ * Implementation of character class scanning
+ */
+enum ScanMode{
+    SCAN_AUTO,
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2
+};
+
+/**
+ * Character class scanners used by the lexer
+ * Every function scans [cur, end) and returns the first byte
+ * which does not belong to the class (end if all of them do).
+ * Newlines passed over are added to lines.
+ */
+typedef struct Scanner{
+    const char *(*skipSpace)(const char *cur, const char *end, int &lines);
+    const char *(*skipAlnum)(const char *cur, const char *end);
+    const char *(*skipDigit)(const char *cur, const char *end);
+    //Returns the position of "*/", end if it is not in [cur, end)
+    const char *(*findCommentEnd)(const char *cur, const char *end, int &lines);
+}Scanner;
+
+/**
+ * Character class table (C locale)
+ */
+enum CharClass{
+    CHAR_SPACE = 1,
+    CHAR_ALPHA = 2,
+    CHAR_DIGIT = 4
+};
+extern const unsigned char CharClassTable[256];
+
+inline bool isSpaceChar(char c){return CharClassTable[(unsigned char)c] & CHAR_SPACE;}
+inline bool isAlphaChar(char c){return CharClassTable[(unsigned char)c] & CHAR_ALPHA;}
+inline bool isDigitChar(char c){return CharClassTable[(unsigned char)c] & CHAR_DIGIT;}
+inline bool isAlnumChar(char c){
+    return CharClassTable[(unsigned char)c] & (CHAR_ALPHA | CHAR_DIGIT);
+}
+
+bool setScanMode(ScanMode mode);
+ScanMode getScanMode();
+bool isScanModeSupported(ScanMode mode);
+const char *getScanModeName(ScanMode mode);
+const Scanner &getScanner();
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SPECULATOR_HPP
+#define SPECULATOR_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/IR/Function.h>
+#include "APP.hpp"
+
+
+/**
+ * Background compilation of the callees of the functions the lazy JIT
+ * has compiled, so that their first call does not stall on compilation.
+ * The static call graph comes from the CallExprAST nodes seen by CodeGen.
+ * A DummyC body has no branch, so every callee of a function that runs is
+ * called: each function compiled ahead is a stall hidden from the thread
+ * running the program.
+ * Compilations are serialized by the lock of the JIT; the workers only
+ * move them off the thread running the program.
+ */
+class Speculator : public llvm::JITEventListener{
+    private:
+        llvm::ExecutionEngine *Engine;
+        const llvm::Function *Entry;        //Compiled before anything runs, not a stall
+        llvm::DenseMap<const llvm::Function*, std::vector<llvm::Function*> > Callees;
+        llvm::DenseSet<const llvm::Function*> Seen;    //Queued or compiled
+        std::deque<llvm::Function*> Queue;
+        std::mutex Lock;
+        std::condition_variable Ready;
+        bool Stopping;
+        std::vector<std::thread> Workers;
+        std::thread::id RunThread;          //Thread running the program
+        std::atomic<long> CompiledAhead;    //Compiled by the workers
+        std::atomic<long> Stalls;           //Compiled on the first call
+
+    public:
+        Speculator(llvm::ExecutionEngine *engine, const llvm::Function *entry);
+        ~Speculator();
+        bool addCall(const llvm::Function *caller, llvm::Function *callee);
+        bool start(int threads);
+        bool stop();
+        long getCompiledAhead(){return CompiledAhead;}
+        long getStalls(){return Stalls;}
+
+        virtual void NotifyFunctionEmitted(const llvm::Function &func, void *code, size_t size,
+                const llvm::JITEventListener::EmittedFunctionDetails &details);
+
+    private:
+        void runWorker();
+};
+
+#endif
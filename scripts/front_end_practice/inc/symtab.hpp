@@ -0,0 +1,53 @@
+#ifndef SYMTAB_HPP
+#define SYMTAB_HPP
+
+#include<vector>
+#include<llvm/ADT/DenseMap.h>
+#include"APP.hpp"
+#include"AST.hpp"
+
+/**
+ * Scoped table of variable declarations
+ * Index is an open addressed hash table from SymbolID to the innermost
+ * declaration in scope; a declaration remembers the one it shadows, so
+ * popping a scope restores the outer declarations.
+ * Names are not erased from Index when they go out of scope (the entry
+ * becomes -1), which keeps the hash table free of tombstones.
+ */
+class SymbolTable{
+    private:
+        /**
+         * Declaration in scope
+         */
+        typedef struct Entry{
+            SymbolID Name;
+            VariableDeclAST *Decl;
+            int Shadowed;       //Entry of the outer declaration of Name (-1 if none)
+        }Entry;
+
+        llvm::DenseMap<SymbolID, int> Index;    //Innermost entry of each name (-1 if none)
+        std::vector<Entry> Entries;             //Declarations in scope, innermost last
+        std::vector<int> Scopes;                //First entry of each scope
+
+    public:
+        SymbolTable(){}
+        ~SymbolTable(){}
+
+        bool pushScope();
+        bool popScope();
+        bool declare(SymbolID name, VariableDeclAST *decl);
+        int getDepth(){return Scopes.size();}
+
+        /**
+         * Look up the innermost declaration of name
+         * @return declaration, NULL if name is not declared in any scope
+         */
+        VariableDeclAST *lookup(SymbolID name){
+            llvm::DenseMap<SymbolID, int>::iterator iter = Index.find(name);
+            if (iter == Index.end() || iter->second < 0)
+                return NULL;
+            return Entries[iter->second].Decl;
+        }
+};
+
+#endif
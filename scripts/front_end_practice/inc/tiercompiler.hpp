@@ -0,0 +1,79 @@
+#ifndef TIER_COMPILER_HPP
+#define TIER_COMPILER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+#include "APP.hpp"
+#include "AST.hpp"
+#include "codegen.hpp"
+#include "interpreter.hpp"
+#include "optimizer.hpp"
+
+
+/**
+ * Optimization level of the functions tiered up
+ */
+static const int TierOptLevel = 2;
+
+/**
+ * Second tier of the Interpreter: compiles the functions whose calls
+ * reach the threshold on a background thread and installs their code.
+ * A hot function is compiled with the functions it reaches that are not
+ * native yet, so native code never calls back into the interpreter; the
+ * functions already native are declared and mapped to their code. Each
+ * group is one module (CodeGen, the -O2 pipeline, then the JIT) which
+ * adds an entry "name.tier" taking the arguments as an array, the
+ * signature of NativeFunction, and calls builtins through
+ * "name.builtin" mapped to the BuiltinFunction of the Interpreter, unless
+ * the program defines a function of that name.
+ * A group with recursive calls stays interpreted: without branches the
+ * recursion never returns, and the Interpreter reports the depth of the
+ * calls where native code would overflow the stack.
+ * Only the background thread uses LLVM after start().
+ * Each tier-up is logged on stderr.
+ */
+class TierCompiler : public TierUpHandler{
+    private:
+        TranslationUnitAST *TU;
+        Interpreter *Interp;
+        unsigned Threshold;
+        llvm::ExecutionEngine *Engine;
+        std::vector<CodeGen*> Modules;          //CodeGen owning each module of Engine
+        std::vector<bool> Compiled;             //Compiled or being compiled, by function index
+        std::vector<void*> Code;                //Code of each compiled function
+        std::deque<int> Queue;
+        std::mutex Lock;
+        std::condition_variable Ready;
+        bool Stopping;
+        std::thread Worker;
+        std::atomic<long> TierUps;
+        std::atomic<long> NativeFunctions;
+
+    public:
+        TierCompiler(TranslationUnitAST &tunit, Interpreter *interp, unsigned threshold);
+        ~TierCompiler();
+        bool start();
+        bool stop();
+        long getTierUps(){return TierUps;}
+        long getNativeFunctions(){return NativeFunctions;}
+
+        virtual bool requestTierUp(int func);
+
+    private:
+        void runWorker();
+        bool compile(int func);
+        bool hasRecursion(const std::vector<int> &group);
+        llvm::Function *generateEntry(llvm::Function *func, llvm::IRBuilder<> &builder);
+        bool generateBuiltin(llvm::Function *func, BuiltinFunction builtin,
+                llvm::IRBuilder<> &builder, std::vector<std::pair<llvm::Function*, void*> > &mappings);
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "AST.hpp"
+
+
+/**
+ * Destructor
+ * Nodes are trivially destructible, releasing the arenas frees them all
+ */
+TranslationUnitAST::~TranslationUnitAST(){
+    for (int i=0; i<AdoptedArenas.size(); i++)
+        SAFE_DELETE(AdoptedArenas[i]);
+}
+
+/**
+ * Add prototype to TranslationUnit
+ * @param PrototypeAST
+ * @return true
+ */
+bool TranslationUnitAST::addPrototype(PrototypeAST *proto){
+    Prototypes.push_back(proto);
+    return true;
+}
+
+/**
+ * Add function to TranslationUnit
+ * @param FunctionAST
+ * @return true
+ */
+bool TranslationUnitAST::addFunction(FunctionAST *func){
+    Functions.push_back(func);
+    return true;
+}
+
+/**
+ * Take ownership of an arena holding nodes of this TranslationUnit
+ * @param arena allocated with new
+ * @return true
+ */
+bool TranslationUnitAST::adoptAllocator(llvm::BumpPtrAllocator *arena){
+    AdoptedArenas.push_back(arena);
+    return true;
+}
+
+/**
+ * Memory held by the arenas (bytes)
+ */
+size_t TranslationUnitAST::getArenaSize(){
+    size_t size = Arena.getTotalMemory();
+    for (int i=0; i<AdoptedArenas.size(); i++)
+        size += AdoptedArenas[i]->getTotalMemory();
+    return size;
+}
+
+/**
+ * Check whether TranslationUnit is empty
+ * @return empty: true otherwise: false
+ */
+bool TranslationUnitAST::empty(){
+    if (Prototypes.size() == 0 && Functions.size() == 0)
+        return true;
+    else
+        return false;
+}
+
+
+/**
+ * i-th operand of expression (or statement) in evaluation order
+ * The variable on the left of '=' is not an operand, it is the target
+ * of the assignment
+ * Tree walkers use this to keep an explicit stack instead of recursing
+ * @return operand, NULL if node has no more operands
+ */
+BaseAST *getOperand(BaseAST *node, int i){
+    switch (node->getValueID()){
+        case BinaryExprID: {
+            BinaryExprAST *bin_expr = llvm::cast<BinaryExprAST>(node);
+            if (bin_expr->getOp() == "=")
+                return i == 0 ? bin_expr->getRHS() : NULL;
+            return i == 0 ? bin_expr->getLHS() : i == 1 ? bin_expr->getRHS() : NULL;
+        }
+        case CallExprID:
+            return llvm::cast<CallExprAST>(node)->getArgs(i);
+        case JumpStmtID:
+            return i == 0 ? llvm::cast<JumpStmtAST>(node)->getExpr() : NULL;
+        default:
+            return NULL;
+    }
+}
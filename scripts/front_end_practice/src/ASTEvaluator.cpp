@@ -0,0 +1,274 @@
+#include <stdint.h>
+#include <llvm/ADT/DenseMap.h>
+#include "ASTEvaluator.hpp"
+#include "ASTVisitor.hpp"
+
+
+/**
+ * Fold op of two constants as the instructions of CodeGen compute it:
+ * + - * wrap at 32 bits, / truncates
+ * @return success: true (value in result) fail: false (the division traps)
+ */
+bool foldConstant(llvm::StringRef op, int lhs, int rhs, int &result){
+    uint32_t l = lhs, r = rhs;
+    if (op == "+"){
+        result = (int)(l + r);
+    }else if (op == "-"){
+        result = (int)(l - r);
+    }else if (op == "*"){
+        result = (int)(l * r);
+    }else if (op == "/"){
+        if (rhs == 0 || (lhs == INT32_MIN && rhs == -1))
+            return false;
+        result = lhs / rhs;
+    }else{
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Collector of the functions called by a statement
+ */
+class CalleeCollector : public PostOrderVisitor<CalleeCollector, int>{
+    friend class ASTVisitor<CalleeCollector, bool, llvm::ArrayRef<int>, int&>;
+
+    public:
+        std::vector<SymbolID> Callees;
+
+    private:
+        bool visitVariableDecl(VariableDeclAST*, llvm::ArrayRef<int>, int&){return true;}
+        bool visitBinaryExpr(BinaryExprAST*, llvm::ArrayRef<int>, int&){return true;}
+        bool visitNullExpr(NullExprAST*, llvm::ArrayRef<int>, int&){return true;}
+        bool visitCallExpr(CallExprAST *call_expr, llvm::ArrayRef<int>, int&){
+            Callees.push_back(call_expr->getCallee());
+            return true;
+        }
+        bool visitJumpStmt(JumpStmtAST*, llvm::ArrayRef<int>, int&){return true;}
+        bool visitVariable(VariableAST*, llvm::ArrayRef<int>, int&){return true;}
+        bool visitNumber(NumberAST*, llvm::ArrayRef<int>, int&){return true;}
+};
+
+
+/**
+ * Interpreter of one activation of a pure function
+ * The result of each AST node is its value. A call is run by the
+ * FunctionEvaluator of the next depth, as walk() is not reentrant
+ */
+class FunctionEvaluator : public PostOrderVisitor<FunctionEvaluator, int>{
+    friend class ASTVisitor<FunctionEvaluator, bool, llvm::ArrayRef<int>, int&>;
+
+    private:
+        ASTEvaluator *Owner;
+        int Depth;
+        llvm::DenseMap<VariableDeclAST*, int> Locals;   //Values of the variables assigned
+
+    public:
+        FunctionEvaluator(ASTEvaluator *owner, int depth): Owner(owner), Depth(depth){}
+        bool run(FunctionAST *func, llvm::ArrayRef<int> args, int &result);
+
+    private:
+        bool visitVariableDecl(VariableDeclAST *vdecl, llvm::ArrayRef<int> operands, int &value);
+        bool visitBinaryExpr(BinaryExprAST *bin_expr, llvm::ArrayRef<int> operands, int &value);
+        bool visitNullExpr(NullExprAST *null_expr, llvm::ArrayRef<int> operands, int &value);
+        bool visitCallExpr(CallExprAST *call_expr, llvm::ArrayRef<int> operands, int &value);
+        bool visitJumpStmt(JumpStmtAST *jump_stmt, llvm::ArrayRef<int> operands, int &value);
+        bool visitVariable(VariableAST *var, llvm::ArrayRef<int> operands, int &value);
+        bool visitNumber(NumberAST *num, llvm::ArrayRef<int> operands, int &value);
+};
+
+
+/**
+ * Run the body of func with args until its first return
+ * @return success: true (returned value in result) fail: false
+ */
+bool FunctionEvaluator::run(FunctionAST *func, llvm::ArrayRef<int> args, int &result){
+    FunctionStmtAST *body = func->getBody();
+    Locals.clear();
+
+    //Parameters come first in the order of the arguments
+    int num_args = 0;
+    for (int i=0; body->getVariableDecl(i); i++){
+        VariableDeclAST *vdecl = body->getVariableDecl(i);
+        if (vdecl->getType() == VariableDeclAST::param){
+            if (num_args >= args.size())
+                return false;
+            Locals[vdecl] = args[num_args++];
+        }
+    }
+
+    for (int i=0; body->getStatement(i); i++){
+        BaseAST *stmt = body->getStatement(i);
+        int value;
+        if (!walk(stmt, value))
+            return false;
+        if (llvm::isa<JumpStmtAST>(stmt)){
+            result = value;
+            return true;
+        }
+    }
+
+    //Ends without return
+    return false;
+}
+
+/**
+ * Methods computing the value of an AST node from the values of its
+ * operands; each node is one step of the budget
+ * @return success: true fail: false
+ */
+bool FunctionEvaluator::visitVariableDecl(VariableDeclAST*, llvm::ArrayRef<int>, int&){
+    //Declarations are not statements
+    return false;
+}
+
+bool FunctionEvaluator::visitBinaryExpr(BinaryExprAST *bin_expr, llvm::ArrayRef<int> operands, int &value){
+    if (!Owner->step())
+        return false;
+    if (bin_expr->getOp() == "="){
+        VariableAST *var = llvm::cast<VariableAST>(bin_expr->getLHS());
+        Locals[var->getDecl()] = operands[0];
+        value = operands[0];
+        return true;
+    }
+    return foldConstant(bin_expr->getOp(), operands[0], operands[1], value);
+}
+
+bool FunctionEvaluator::visitNullExpr(NullExprAST*, llvm::ArrayRef<int>, int &value){
+    value = 0;
+    return true;
+}
+
+bool FunctionEvaluator::visitCallExpr(CallExprAST *call_expr, llvm::ArrayRef<int> operands, int &value){
+    if (!Owner->step())
+        return false;
+    return Owner->callFunction(call_expr->getCallee(), operands, Depth + 1, value);
+}
+
+bool FunctionEvaluator::visitJumpStmt(JumpStmtAST*, llvm::ArrayRef<int> operands, int &value){
+    if (!Owner->step())
+        return false;
+    value = operands[0];
+    return true;
+}
+
+bool FunctionEvaluator::visitVariable(VariableAST *var, llvm::ArrayRef<int>, int &value){
+    if (!Owner->step())
+        return false;
+    llvm::DenseMap<VariableDeclAST*, int>::iterator local = Locals.find(var->getDecl());
+    if (local == Locals.end())
+        return false;
+    value = local->second;
+    return true;
+}
+
+bool FunctionEvaluator::visitNumber(NumberAST *num, llvm::ArrayRef<int>, int &value){
+    if (!Owner->step())
+        return false;
+    value = num->getNumberValue();
+    return true;
+}
+
+
+/**
+ * Constructor
+ * @param TranslationUnitAST, steps allowed to one call
+ */
+ASTEvaluator::ASTEvaluator(TranslationUnitAST &tunit, long budget)
+    : TU(&tunit), Budget(budget), Steps(0), TooDeep(false){
+    analyzePurity();
+}
+
+/**
+ * Destructor
+ */
+ASTEvaluator::~ASTEvaluator(){
+    for (int i=0; i<Frames.size(); i++)
+        SAFE_DELETE(Frames[i]);
+}
+
+/**
+ * Evaluate a call of a function with constant arguments
+ * @return success: true (value in result) fail: false
+ */
+bool ASTEvaluator::evaluateCall(SymbolID callee, llvm::ArrayRef<int> args, int &result){
+    if (!isPure(callee) || TooCostly[callee])
+        return false;
+    Steps = 0;
+    TooDeep = false;
+    if (callFunction(callee, args, 0, result))
+        return true;
+    if (Steps > Budget || TooDeep)
+        TooCostly[callee] = true;
+    return false;
+}
+
+/**
+ * Run a pure function on the FunctionEvaluator of depth
+ * @return success: true (value in result) fail: false
+ */
+bool ASTEvaluator::callFunction(SymbolID callee, llvm::ArrayRef<int> args, int depth, int &result){
+    if (depth >= MaxCallDepth){
+        TooDeep = true;
+        return false;
+    }
+    if (!isPure(callee))
+        return false;
+    if (depth == Frames.size())
+        Frames.push_back(new FunctionEvaluator(this, depth));
+    return Frames[depth]->run(Definitions[callee], args, result);
+}
+
+/**
+ * Mark the pure functions
+ * Functions calling one that is not defined are impure, and impurity
+ * is propagated to the callers over the reverse call graph
+ * @return success: true fail: false
+ */
+bool ASTEvaluator::analyzePurity(){
+    size_t num_symbols = TU->getSymbols()->size();
+    Definitions.assign(num_symbols, NULL);
+    Pure.assign(num_symbols, false);
+    TooCostly.assign(num_symbols, false);
+    for (int i=0; TU->getFunction(i); i++){
+        FunctionAST *func = TU->getFunction(i);
+        Definitions[func->getName()] = func;
+        Pure[func->getName()] = true;
+    }
+
+    std::vector<std::vector<SymbolID> > callers(num_symbols);
+    std::vector<SymbolID> impure;
+    CalleeCollector collector;
+    for (int i=0; TU->getFunction(i); i++){
+        SymbolID name = TU->getFunction(i)->getName();
+        FunctionStmtAST *body = TU->getFunction(i)->getBody();
+        int none;
+        collector.Callees.clear();
+        for (int j=0; body->getStatement(j); j++)
+            collector.walk(body->getStatement(j), none);
+
+        for (int j=0; j<collector.Callees.size(); j++){
+            SymbolID callee = collector.Callees[j];
+            if (Definitions[callee]){
+                callers[callee].push_back(name);
+            }else if (Pure[name]){
+                Pure[name] = false;
+                impure.push_back(name);
+            }
+        }
+    }
+
+    while (!impure.empty()){
+        SymbolID func = impure.back();
+        impure.pop_back();
+        for (int i=0; i<callers[func].size(); i++){
+            SymbolID caller = callers[func][i];
+            if (Pure[caller]){
+                Pure[caller] = false;
+                impure.push_back(caller);
+            }
+        }
+    }
+    return true;
+}
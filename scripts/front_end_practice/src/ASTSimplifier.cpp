@@ -0,0 +1,318 @@
+#include <stdint.h>
+#include <utility>
+#include <llvm/ADT/DenseMap.h>
+#include "ASTSimplifier.hpp"
+#include "ASTEvaluator.hpp"
+#include "ASTVisitor.hpp"
+
+
+/**
+ * Expression after simplification
+ */
+typedef struct SimpleExpr{
+    BaseAST *Node;
+    bool Pure;      //Has no call and no division, so it may be dropped
+}SimpleExpr;
+
+
+/**
+ * Simplifier of the expressions of a TranslationUnit
+ * The result of each AST node is the node replacing it, which is the
+ * node itself when nothing changed below it
+ */
+class ASTSimplifier : public PostOrderVisitor<ASTSimplifier, SimpleExpr>{
+    friend class ASTVisitor<ASTSimplifier, bool, llvm::ArrayRef<SimpleExpr>, SimpleExpr&>;
+
+    private:
+        TranslationUnitAST *TU;
+        ASTEvaluator *Evaluator;            //Evaluator of pure calls (NULL if disabled)
+        std::vector<BaseAST*> StmtBuffer;   //Statements of the function being simplified
+        std::vector<BaseAST*> ArgBuffer;    //Arguments of a call being rebuilt
+        std::vector<int> ArgValues;         //Constant arguments of a call being evaluated
+        llvm::DenseMap<VariableDeclAST*, int> Constants;    //Locals holding a known constant
+        std::vector<std::pair<BaseAST*, BaseAST*> > CompareStack;   //Explicit stack of isSameExpression
+
+    public:
+        ASTSimplifier(TranslationUnitAST &tunit, long eval_budget);
+        ~ASTSimplifier();
+        bool simplify();
+
+    private:
+        bool simplifyFunction(FunctionStmtAST *body);
+        SimpleExpr makeBinary(llvm::StringRef op, SimpleExpr lhs, SimpleExpr rhs, BinaryExprAST *orig);
+        SimpleExpr makeNumber(int value);
+        bool isSameExpression(BaseAST *lhs, BaseAST *rhs);
+
+        bool visitVariableDecl(VariableDeclAST *vdecl, llvm::ArrayRef<SimpleExpr> operands, SimpleExpr &expr);
+        bool visitBinaryExpr(BinaryExprAST *bin_expr, llvm::ArrayRef<SimpleExpr> operands, SimpleExpr &expr);
+        bool visitNullExpr(NullExprAST *null_expr, llvm::ArrayRef<SimpleExpr> operands, SimpleExpr &expr);
+        bool visitCallExpr(CallExprAST *call_expr, llvm::ArrayRef<SimpleExpr> operands, SimpleExpr &expr);
+        bool visitJumpStmt(JumpStmtAST *jump_stmt, llvm::ArrayRef<SimpleExpr> operands, SimpleExpr &expr);
+        bool visitVariable(VariableAST *var, llvm::ArrayRef<SimpleExpr> operands, SimpleExpr &expr);
+        bool visitNumber(NumberAST *num, llvm::ArrayRef<SimpleExpr> operands, SimpleExpr &expr);
+};
+
+
+/**
+ * Constructor
+ * @param TranslationUnitAST, steps allowed to the evaluation of a call
+ * (0 disables the evaluation)
+ */
+ASTSimplifier::ASTSimplifier(TranslationUnitAST &tunit, long eval_budget): TU(&tunit){
+    Evaluator = eval_budget > 0 ? new ASTEvaluator(tunit, eval_budget) : NULL;
+}
+
+/**
+ * Destructor
+ */
+ASTSimplifier::~ASTSimplifier(){
+    SAFE_DELETE(Evaluator);
+}
+
+/**
+ * Simplify all function bodies
+ * @return success: true fail: false
+ */
+bool ASTSimplifier::simplify(){
+    for (int i=0; TU->getFunction(i); i++){
+        if (!simplifyFunction(TU->getFunction(i)->getBody()))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Simplify the statements of a function body
+ * The statement list is copied only when a statement is replaced
+ * @return success: true fail: false
+ */
+bool ASTSimplifier::simplifyFunction(FunctionStmtAST *body){
+    bool changed = false;
+    StmtBuffer.clear();
+    Constants.clear();
+    for (int i=0; body->getStatement(i); i++){
+        SimpleExpr stmt;
+        if (!walk(body->getStatement(i), stmt))
+            return false;
+        if (stmt.Node != body->getStatement(i))
+            changed = true;
+        StmtBuffer.push_back(stmt.Node);
+    }
+
+    if (changed)
+        body->setStatements(TU->copyArray(llvm::ArrayRef<BaseAST*>(StmtBuffer)));
+    return true;
+}
+
+/**
+ * Binary expression of simplified operands
+ * Folds constants, moves the constant operand of + and * to the right
+ * (x - c becomes x + -c), reassociates (x + c1) + c2 and (x * c1) * c2,
+ * and applies x + 0, x * 1, x / 1, x * 0 and x - x
+ * @param orig node the operands come from, NULL if there is none
+ * @return simplified expression (orig if nothing changed)
+ */
+SimpleExpr ASTSimplifier::makeBinary(llvm::StringRef op, SimpleExpr lhs, SimpleExpr rhs, BinaryExprAST *orig){
+    NumberAST *lhs_num = llvm::dyn_cast<NumberAST>(lhs.Node);
+    NumberAST *rhs_num = llvm::dyn_cast<NumberAST>(rhs.Node);
+    int value;
+
+    //Constant folding
+    if (lhs_num && rhs_num &&
+            foldConstant(op, lhs_num->getNumberValue(), rhs_num->getNumberValue(), value))
+        return makeNumber(value);
+
+    //Constant operand to the right
+    if (lhs_num && !rhs_num && (op == "+" || op == "*")){
+        std::swap(lhs, rhs);
+        std::swap(lhs_num, rhs_num);
+        orig = NULL;
+    }
+    if (rhs_num && op == "-"){
+        op = "+";
+        rhs = makeNumber((int)(0u - (uint32_t)rhs_num->getNumberValue()));
+        rhs_num = llvm::cast<NumberAST>(rhs.Node);
+        orig = NULL;
+    }
+
+    if (rhs_num){
+        int c = rhs_num->getNumberValue();
+        if ((op == "+" && c == 0) || ((op == "*" || op == "/") && c == 1))
+            return lhs;
+        if (op == "*" && c == 0 && lhs.Pure)
+            return makeNumber(0);
+
+        //(x + c1) + c2 => x + (c1 + c2)
+        BinaryExprAST *inner = llvm::dyn_cast<BinaryExprAST>(lhs.Node);
+        if (inner && inner->getOp() == op && (op == "+" || op == "*")){
+            if (NumberAST *inner_num = llvm::dyn_cast<NumberAST>(inner->getRHS())){
+                foldConstant(op, inner_num->getNumberValue(), c, value);
+                SimpleExpr inner_lhs = {inner->getLHS(), lhs.Pure};
+                return makeBinary(op, inner_lhs, makeNumber(value), NULL);
+            }
+        }
+    }
+
+    if (op == "-" && lhs.Pure && isSameExpression(lhs.Node, rhs.Node))
+        return makeNumber(0);
+
+    SimpleExpr expr;
+    expr.Pure = lhs.Pure && rhs.Pure && op != "/";
+    if (orig && lhs.Node == orig->getLHS() && rhs.Node == orig->getRHS())
+        expr.Node = orig;
+    else
+        expr.Node = new (TU->getAllocator()) BinaryExprAST(op, lhs.Node, rhs.Node);
+    return expr;
+}
+
+SimpleExpr ASTSimplifier::makeNumber(int value){
+    SimpleExpr expr = {new (TU->getAllocator()) NumberAST(value), true};
+    return expr;
+}
+
+/**
+ * Whether two pure expressions compute the same value
+ * (same shape, numbers and declarations)
+ */
+bool ASTSimplifier::isSameExpression(BaseAST *lhs, BaseAST *rhs){
+    CompareStack.clear();
+    CompareStack.push_back(std::make_pair(lhs, rhs));
+    while (!CompareStack.empty()){
+        BaseAST *a = CompareStack.back().first;
+        BaseAST *b = CompareStack.back().second;
+        CompareStack.pop_back();
+        if (a == b)
+            continue;
+        if (a->getValueID() != b->getValueID())
+            return false;
+
+        switch (a->getValueID()){
+            case NumberID:
+                if (llvm::cast<NumberAST>(a)->getNumberValue() != llvm::cast<NumberAST>(b)->getNumberValue())
+                    return false;
+                break;
+            case VariableID:
+                if (llvm::cast<VariableAST>(a)->getDecl() != llvm::cast<VariableAST>(b)->getDecl())
+                    return false;
+                break;
+            case BinaryExprID: {
+                BinaryExprAST *bin_a = llvm::cast<BinaryExprAST>(a);
+                BinaryExprAST *bin_b = llvm::cast<BinaryExprAST>(b);
+                if (bin_a->getOp() != bin_b->getOp())
+                    return false;
+                CompareStack.push_back(std::make_pair(bin_a->getLHS(), bin_b->getLHS()));
+                CompareStack.push_back(std::make_pair(bin_a->getRHS(), bin_b->getRHS()));
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Methods simplifying an AST node, whose operands are already simplified
+ * @return success: true fail: false
+ */
+bool ASTSimplifier::visitVariableDecl(VariableDeclAST *vdecl, llvm::ArrayRef<SimpleExpr>, SimpleExpr &expr){
+    expr.Node = vdecl;
+    expr.Pure = true;
+    return true;
+}
+
+bool ASTSimplifier::visitBinaryExpr(BinaryExprAST *bin_expr, llvm::ArrayRef<SimpleExpr> operands, SimpleExpr &expr){
+    if (bin_expr->getOp() != "="){
+        expr = makeBinary(bin_expr->getOp(), operands[0], operands[1], bin_expr);
+        return true;
+    }
+
+    //operands[0] is the right side; the body has no branch, so the
+    //variable holds a constant until the next assignment
+    VariableDeclAST *decl = llvm::cast<VariableAST>(bin_expr->getLHS())->getDecl();
+    if (NumberAST *num = llvm::dyn_cast<NumberAST>(operands[0].Node))
+        Constants[decl] = num->getNumberValue();
+    else
+        Constants.erase(decl);
+
+    expr.Pure = false;
+    if (operands[0].Node == bin_expr->getRHS())
+        expr.Node = bin_expr;
+    else
+        expr.Node = new (TU->getAllocator()) BinaryExprAST("=", bin_expr->getLHS(), operands[0].Node);
+    return true;
+}
+
+bool ASTSimplifier::visitNullExpr(NullExprAST *null_expr, llvm::ArrayRef<SimpleExpr>, SimpleExpr &expr){
+    expr.Node = null_expr;
+    expr.Pure = true;
+    return true;
+}
+
+bool ASTSimplifier::visitCallExpr(CallExprAST *call_expr, llvm::ArrayRef<SimpleExpr> operands, SimpleExpr &expr){
+    expr.Node = call_expr;
+    expr.Pure = false;
+
+    bool changed = false;
+    bool constant = true;
+    ArgBuffer.clear();
+    ArgValues.clear();
+    for (int i=0; i<operands.size(); i++){
+        if (operands[i].Node != call_expr->getArgs(i))
+            changed = true;
+        ArgBuffer.push_back(operands[i].Node);
+        if (NumberAST *num = llvm::dyn_cast<NumberAST>(operands[i].Node))
+            ArgValues.push_back(num->getNumberValue());
+        else
+            constant = false;
+    }
+
+    //Call of a pure function with constant arguments
+    int value;
+    if (constant && Evaluator && Evaluator->isPure(call_expr->getCallee()) &&
+            Evaluator->evaluateCall(call_expr->getCallee(), ArgValues, value)){
+        expr = makeNumber(value);
+        return true;
+    }
+    if (changed)
+        expr.Node = new (TU->getAllocator()) CallExprAST(call_expr->getCallee(),
+                TU->copyArray(llvm::ArrayRef<BaseAST*>(ArgBuffer)));
+    return true;
+}
+
+bool ASTSimplifier::visitJumpStmt(JumpStmtAST *jump_stmt, llvm::ArrayRef<SimpleExpr> operands, SimpleExpr &expr){
+    expr.Pure = false;
+    if (operands[0].Node == jump_stmt->getExpr())
+        expr.Node = jump_stmt;
+    else
+        expr.Node = new (TU->getAllocator()) JumpStmtAST(operands[0].Node);
+    return true;
+}
+
+bool ASTSimplifier::visitVariable(VariableAST *var, llvm::ArrayRef<SimpleExpr>, SimpleExpr &expr){
+    llvm::DenseMap<VariableDeclAST*, int>::iterator constant = Constants.find(var->getDecl());
+    if (constant != Constants.end()){
+        expr = makeNumber(constant->second);
+        return true;
+    }
+    expr.Node = var;
+    expr.Pure = true;
+    return true;
+}
+
+bool ASTSimplifier::visitNumber(NumberAST *num, llvm::ArrayRef<SimpleExpr>, SimpleExpr &expr){
+    expr.Node = num;
+    expr.Pure = true;
+    return true;
+}
+
+
+/**
+ * Simplify the expressions of TranslationUnitAST in place
+ * @param TranslationUnitAST, steps allowed to the evaluation of a call
+ * @return success: true fail: false
+ */
+bool simplifyAST(TranslationUnitAST &tunit, long eval_budget){
+    ASTSimplifier simplifier(tunit, eval_budget);
+    return simplifier.simplify();
+}
@@ -0,0 +1,216 @@
+#include "FlatAST.hpp"
+#include "ASTVisitor.hpp"
+
+
+/**
+ * Add argument list of FLAT_CALL
+ * @return offset of the list
+ */
+uint32_t FlatAST::addArgList(llvm::ArrayRef<uint32_t> args){
+    uint32_t offset = ArgLists.size();
+    ArgLists.push_back(args.size());
+    ArgLists.insert(ArgLists.end(), args.begin(), args.end());
+    return offset;
+}
+
+/**
+ * Heap used by the arrays (bytes)
+ */
+size_t FlatAST::getMemoryUsage(){
+    return Ops.capacity() * sizeof(uint8_t) +
+        OperandA.capacity() * sizeof(uint32_t) +
+        OperandB.capacity() * sizeof(uint32_t) +
+        ArgLists.capacity() * sizeof(uint32_t) +
+        Slots.capacity() * sizeof(SymbolID) +
+        (Prototypes.capacity() + Functions.capacity()) * sizeof(FlatFunction);
+}
+
+/**
+ * Release the spare capacity of the arrays
+ * (copy and swap, shrink_to_fit is a no-op without exceptions)
+ */
+bool FlatAST::shrinkToFit(){
+    std::vector<uint8_t>(Ops).swap(Ops);
+    std::vector<uint32_t>(OperandA).swap(OperandA);
+    std::vector<uint32_t>(OperandB).swap(OperandB);
+    std::vector<uint32_t>(ArgLists).swap(ArgLists);
+    std::vector<SymbolID>(Slots).swap(Slots);
+    std::vector<FlatFunction>(Prototypes).swap(Prototypes);
+    std::vector<FlatFunction>(Functions).swap(Functions);
+    return true;
+}
+
+
+/**
+ * Converter from TranslationUnitAST to FlatAST
+ * The result of each AST node is the index of its flat node
+ */
+class FlatASTBuilder : public PostOrderVisitor<FlatASTBuilder, uint32_t>{
+    friend class ASTVisitor<FlatASTBuilder, bool, llvm::ArrayRef<uint32_t>, uint32_t&>;
+
+    private:
+        FlatAST *Flat;
+        std::vector<int> SlotOf;        //Slot of variable indexed by SymbolID (-1 if none)
+
+    public:
+        FlatASTBuilder(): Flat(NULL){}
+        FlatAST *build(TranslationUnitAST &tunit);
+
+    private:
+        FlatFunction addPrototype(PrototypeAST *proto);
+        bool addFunction(FunctionAST *func);
+
+        bool visitVariableDecl(VariableDeclAST *vdecl, llvm::ArrayRef<uint32_t> operands, uint32_t &index);
+        bool visitBinaryExpr(BinaryExprAST *bin_expr, llvm::ArrayRef<uint32_t> operands, uint32_t &index);
+        bool visitNullExpr(NullExprAST *null_expr, llvm::ArrayRef<uint32_t> operands, uint32_t &index);
+        bool visitCallExpr(CallExprAST *call_expr, llvm::ArrayRef<uint32_t> operands, uint32_t &index);
+        bool visitJumpStmt(JumpStmtAST *jump_stmt, llvm::ArrayRef<uint32_t> operands, uint32_t &index);
+        bool visitVariable(VariableAST *var, llvm::ArrayRef<uint32_t> operands, uint32_t &index);
+        bool visitNumber(NumberAST *num, llvm::ArrayRef<uint32_t> operands, uint32_t &index);
+};
+
+
+/**
+ * Build FlatAST
+ * @return success: FlatAST fail: NULL
+ */
+FlatAST *FlatASTBuilder::build(TranslationUnitAST &tunit){
+    Flat = new FlatAST(tunit.getSymbols());
+    SlotOf.assign(tunit.getSymbols()->size(), -1);
+
+    for (int i=0; tunit.getPrototype(i); i++)
+        Flat->addPrototype(addPrototype(tunit.getPrototype(i)));
+
+    for (int i=0; tunit.getFunction(i); i++){
+        if (!addFunction(tunit.getFunction(i))){
+            SAFE_DELETE(Flat);
+            return NULL;
+        }
+    }
+    Flat->shrinkToFit();
+    return Flat;
+}
+
+/**
+ * Register parameters as slots
+ */
+FlatFunction FlatASTBuilder::addPrototype(PrototypeAST *proto){
+    FlatFunction func;
+    func.Name = proto->getName();
+    func.NumParams = proto->getParamNum();
+    func.SlotBegin = Flat->getNumSlots();
+    func.NumSlots = proto->getParamNum();
+    func.NodeBegin = func.NodeEnd = Flat->getNumNodes();
+    for (int i=0; i<proto->getParamNum(); i++)
+        Flat->addSlot(proto->getParamName(i));
+    return func;
+}
+
+/**
+ * Flatten function definition
+ * @return success: true fail: false
+ */
+bool FlatASTBuilder::addFunction(FunctionAST *func_ast){
+    FunctionStmtAST *body = func_ast->getBody();
+    FlatFunction func;
+    func.Name = func_ast->getName();
+    func.NumParams = func_ast->getPrototype()->getParamNum();
+
+    //Declarations, beginning with the parameters
+    func.SlotBegin = Flat->getNumSlots();
+    func.NumSlots = 0;
+    for (int i=0; body->getVariableDecl(i); i++){
+        SymbolID name = body->getVariableDecl(i)->getName();
+        SlotOf[name] = func.NumSlots++;
+        Flat->addSlot(name);
+    }
+
+    //Statements
+    func.NodeBegin = Flat->getNumNodes();
+    bool success = true;
+    uint32_t index;
+    for (int i=0; success && body->getStatement(i); i++)
+        success = walk(body->getStatement(i), index);
+    func.NodeEnd = Flat->getNumNodes();
+
+    for (int i=0; body->getVariableDecl(i); i++)
+        SlotOf[body->getVariableDecl(i)->getName()] = -1;
+
+    if (success)
+        Flat->addFunction(func);
+    return success;
+}
+
+/**
+ * Methods adding the flat node of an AST node, whose operands are
+ * already added
+ * @return success: true fail: false
+ */
+bool FlatASTBuilder::visitVariableDecl(VariableDeclAST*, llvm::ArrayRef<uint32_t>, uint32_t&){
+    //Declarations are slots, not nodes
+    return false;
+}
+
+bool FlatASTBuilder::visitBinaryExpr(BinaryExprAST *bin_expr, llvm::ArrayRef<uint32_t> operands, uint32_t &index){
+    llvm::StringRef op = bin_expr->getOp();
+    if (op == "="){
+        VariableAST *var = llvm::dyn_cast<VariableAST>(bin_expr->getLHS());
+        if (!var || SlotOf[var->getName()] < 0)
+            return false;
+        uint32_t ref = Flat->addNode(FLAT_VAR_REF, SlotOf[var->getName()], 0);
+        index = Flat->addNode(FLAT_ASSIGN, ref, operands[0]);
+        return true;
+    }
+
+    FlatOpcode flat_op;
+    switch (op[0]){
+        case '+': flat_op = FLAT_ADD; break;
+        case '-': flat_op = FLAT_SUB; break;
+        case '*': flat_op = FLAT_MUL; break;
+        case '/': flat_op = FLAT_DIV; break;
+        default: return false;
+    }
+    index = Flat->addNode(flat_op, operands[0], operands[1]);
+    return true;
+}
+
+bool FlatASTBuilder::visitNullExpr(NullExprAST*, llvm::ArrayRef<uint32_t>, uint32_t &index){
+    //Generates nothing
+    index = 0;
+    return true;
+}
+
+bool FlatASTBuilder::visitCallExpr(CallExprAST *call_expr, llvm::ArrayRef<uint32_t> operands, uint32_t &index){
+    uint32_t list = Flat->addArgList(operands);
+    index = Flat->addNode(FLAT_CALL, call_expr->getCallee(), list);
+    return true;
+}
+
+bool FlatASTBuilder::visitJumpStmt(JumpStmtAST*, llvm::ArrayRef<uint32_t> operands, uint32_t &index){
+    index = Flat->addNode(FLAT_RETURN, operands[0], 0);
+    return true;
+}
+
+bool FlatASTBuilder::visitVariable(VariableAST *var, llvm::ArrayRef<uint32_t>, uint32_t &index){
+    int slot = SlotOf[var->getName()];
+    if (slot < 0)
+        return false;
+    index = Flat->addNode(FLAT_VAR_LOAD, slot, 0);
+    return true;
+}
+
+bool FlatASTBuilder::visitNumber(NumberAST *num, llvm::ArrayRef<uint32_t>, uint32_t &index){
+    index = Flat->addNode(FLAT_NUMBER, num->getNumberValue(), 0);
+    return true;
+}
+
+
+/**
+ * Convert TranslationUnitAST to FlatAST
+ * @param TranslationUnitAST
+ * @return success: FlatAST (owned by caller) fail: NULL
+ */
+FlatAST *flattenAST(TranslationUnitAST &tunit){
+    FlatASTBuilder builder;
+    return builder.build(tunit);
+}
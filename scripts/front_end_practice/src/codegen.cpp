@@ -6,6 +6,13 @@
 CodeGen::CodeGen(){
     Builder = new llvm::IRBuilder<>(llvm::getGlobalContext());
     Mod = NULL;
+    Symbols = NULL;
+    SSA = false;
+    SlotLookups = 0;
+    ArgumentStores = 0;
+    Opt = NULL;
+    JITThreads = 0;
+    JITCache = NULL;
 }
 
 /**
@@ -26,25 +33,130 @@ bool CodeGen::doCodeGen(TranslationUnitAST &tunit, std::string name,
     if (!generateTranslationUnit(tunit, name)){
         return false;
     }
+    return finishCodeGen(link_file, with_jit);
+}
+
+/**
+ * Implement code generation from FlatAST
+ * @param FlatAST Module name
+ */
+bool CodeGen::doCodeGen(FlatAST &flat, std::string name,
+        std::string link_file, bool with_jit){
+
+    if (!generateFlatTranslationUnit(flat, name)){
+        return false;
+    }
+    return finishCodeGen(link_file, with_jit);
+}
 
+/**
+ * Link, optimize and run the generated module
+ */
+bool CodeGen::finishCodeGen(std::string link_file, bool with_jit){
     //Link module if linkfile is indicated
     if (!link_file.empty() && !linkModule(Mod, link_file)){
         return false;
     }
 
+    //Optimize before JIT so that the output and JIT run the same code
+    if (Opt && !Opt->run(*Mod)){
+        return false;
+    }
+
     //Do JIT if JIT flag is set true
-    if (with_jit){
-        llvm::ExecutionEngine *EE = llvm::EngineBuilder(Mod).create();
-        llvm::EngineBuilder(Mod).create();
-        llvm::Function *F;
-        if (!(F = Mod->getFunction("main"))){
-            return false;
+    if (with_jit && !runJIT()){
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Run main of the module on the JIT
+ * Compilation is lazy: getPointerToFunction compiles main alone and its
+ * calls go through stubs that compile each callee on the first call, so
+ * the startup follows the code that runs rather than the module size.
+ * With JITThreads, a Speculator compiles the callees of the compiled
+ * functions in the background along the calls recorded by CodeGen.
+ * With JITCache, MCJIT compiles the whole module for the host CPU instead,
+ * as only MCJIT takes an ObjectCache, and an unchanged module is loaded
+ * from the cache without running the backend
+ * @return success: true fail: false
+ */
+bool CodeGen::runJIT(){
+    llvm::Function *main_func = Mod->getFunction("main");
+    if (!main_func){
+        return false;
+    }
+
+    std::string error;
+    llvm::EngineBuilder builder(Mod);
+    builder.setEngineKind(llvm::EngineKind::JIT).setErrorStr(&error);
+    if (JITCache){
+        std::string cpu = llvm::sys::getHostCPUName();
+        std::vector<std::string> attrs;
+        llvm::StringMap<bool> features;
+        if (llvm::sys::getHostCPUFeatures(features)){
+            for (llvm::StringMap<bool>::iterator it = features.begin(); it != features.end(); ++it)
+                attrs.push_back((it->second ? "+" : "-") + it->first().str());
+            std::sort(attrs.begin(), attrs.end());
         }
+        builder.setUseMCJIT(true).setMCPU(cpu).setMAttrs(attrs);
+
+        std::string target = llvm::sys::getProcessTriple() + " " + cpu;
+        for (int i=0; i<attrs.size(); i++)
+            target += " " + attrs[i];
+        JITCache->addModule(Mod, target);
+    }
+    llvm::ExecutionEngine *engine = builder.create();
+    if (!engine){
+        fprintf(stderr, "%s\n", error.c_str());
+        return false;
+    }
+
+    int (*fp)() = NULL;
+    Speculator *speculator = NULL;
+    if (JITCache){
+        engine->setObjectCache(JITCache);
+        fp = (int (*)())engine->getFunctionAddress("main");
+    }else{
+        engine->DisableLazyCompilation(false);
+
+        //Calls of the functions left after linking and optimization
+        if (JITThreads > 0){
+            speculator = new Speculator(engine, main_func);
+            for (int i=0; i<CallEdges.size(); i++){
+                llvm::Function *caller = Mod->getFunction(Symbols->getString(CallEdges[i].first));
+                llvm::Function *callee = Mod->getFunction(Symbols->getString(CallEdges[i].second));
+                if (caller && callee)
+                    speculator->addCall(caller, callee);
+            }
+            speculator->start(JITThreads);
+        }
+        fp = (int (*)())engine->getPointerToFunction(main_func);
+    }
+    if (!fp){
+        SAFE_DELETE(speculator);
+        engine->removeModule(Mod);
+        SAFE_DELETE(engine);
+        return false;
+    }
+    fprintf(stderr, "%d\n", fp());
 
-        int (*fp)() = (int (*)())EE->getPointerToFunction(F);
-        fprintf(stderr, "%d\n", fp());
+    if (speculator){
+        speculator->stop();
+        fprintf(stderr, "speculation: %ld functions compiled ahead, %ld compiled on the first call\n",
+                speculator->getCompiledAhead(), speculator->getStalls());
+        SAFE_DELETE(speculator);
+    }
+    if (JITCache){
+        fprintf(stderr, "jit cache: %ld hits, %ld misses, %ld evictions\n",
+                JITCache->getHits(), JITCache->getMisses(), JITCache->getEvictions());
     }
 
+    //The module stays with CodeGen
+    engine->removeModule(Mod);
+    SAFE_DELETE(engine);
     return true;
 }
 
@@ -64,6 +176,9 @@ llvm::Module &CodeGen::getModule(){
  */
 bool CodeGen::generateTranslationUnit(TranslationUnitAST &tunit, std::string name){
     Mod = new llvm::Module(name, llvm::getGlobalContext());
+    Symbols = tunit.getSymbols();
+    Functions.assign(Symbols->size(), NULL);
+    CallEdges.clear();
 
     //Function declaration
     for (int i=0; ; i++){
@@ -90,6 +205,40 @@ bool CodeGen::generateTranslationUnit(TranslationUnitAST &tunit, std::string nam
     return true;
 }
 
+/**
+ * Generate a module defining funcs and declaring every other function
+ * of tunit, so that the calls of funcs to them resolve outside the module
+ * The module is neither linked nor optimized
+ * @param TranslationUnitAST, functions to define, Module name
+ */
+bool CodeGen::doFunctionCodeGen(TranslationUnitAST &tunit, llvm::ArrayRef<FunctionAST*> funcs, std::string name){
+    Mod = new llvm::Module(name, llvm::getGlobalContext());
+    Symbols = tunit.getSymbols();
+    Functions.assign(Symbols->size(), NULL);
+    CallEdges.clear();
+
+    for (int i=0; tunit.getPrototype(i); i++){
+        if (!generatePrototype(tunit.getPrototype(i), Mod)){
+            SAFE_DELETE(Mod);
+            return false;
+        }
+    }
+    for (int i=0; tunit.getFunction(i); i++){
+        if (!generatePrototype(tunit.getFunction(i)->getPrototype(), Mod)){
+            SAFE_DELETE(Mod);
+            return false;
+        }
+    }
+
+    for (int i=0; i<funcs.size(); i++){
+        if (!generateFunctionDefinition(funcs[i], Mod)){
+            SAFE_DELETE(Mod);
+            return false;
+        }
+    }
+    return true;
+}
+
 /**
  * Method of function definition
  * @param FunctionAST Module
@@ -101,6 +250,10 @@ llvm::Function *CodeGen::generateFunctionDefinition(FunctionAST *func_ast, llvm:
         return NULL;
     }
     CurFunc = func;
+    CurName = func_ast->getName();
+    VariableSlots.clear();
+    CurrentDefs.clear();
+    NextArg = func->arg_begin();
     llvm::BasicBlock *bblock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "entry", func);
     Builder->SetInsertPoint(bblock);
     generateFunctionStatement(func_ast->getBody());
@@ -112,19 +265,32 @@ llvm::Function *CodeGen::generateFunctionDefinition(FunctionAST *func_ast, llvm:
  * Method of function declaration
  */
 llvm::Function *CodeGen::generatePrototype(PrototypeAST *proto, llvm::Module *mod){
+    std::vector<SymbolID> params;
+    for (int i=0; i<proto->getParamNum(); i++)
+        params.push_back(proto->getParamName(i));
+    return declareFunction(proto->getName(), params, mod);
+}
+
+/**
+ * Declare function taking and returning int
+ * @param function name, parameter names
+ * @return declared Function, NULL if it is redefined
+ */
+llvm::Function *CodeGen::declareFunction(SymbolID name, llvm::ArrayRef<SymbolID> params, llvm::Module *mod){
     //Already declared?
-    llvm::Function *func = mod->getFunction(proto->getName());
+    llvm::Function *func = getFunction(name);
     if (func){
-        if (func->arg_size() == proto->getParamNum() && func->empty()){
+        if (func->arg_size() == params.size() && func->empty()){
             return func;
         }else{
-            fprintf(stderr, "error::function %s if redefined", prpto->getName().c_str());
+            fprintf(stderr, "error::function %s is redefined",
+                    Symbols->getName(name).c_str());
             return NULL;
         }
     }
 
     //Create arg_types
-    std::vector<llvm::Type*> int_types(proto->getParamNum(), llvm::Type::getInt32Ty(llvm::getGlobalContext()));
+    std::vector<llvm::Type*> int_types(params.size(), llvm::Type::getInt32Ty(llvm::getGlobalContext()));
 
     //Create func_type
     llvm::FunctionType *func_type = llvm::FunctionType::get(
@@ -135,14 +301,15 @@ llvm::Function *CodeGen::generatePrototype(PrototypeAST *proto, llvm::Module *mo
     //Create function
     func = llvm::Function::Create(func_type,
             llvm::Function::ExternalLinkage,
-            proto->getName(),
+            Symbols->getString(name),
             mod
             );
+    Functions[name] = func;
 
     //Set names
     llvm::Function::arg_iterator arg_iter = func->arg_begin();
-    for (int i=0; i<proto->getParamNum(); i++){
-        arg_iter->setName(proto->getParamName(i).append("_arg"));
+    for (int i=0; i<params.size(); i++){
+        arg_iter->setName(Symbols->getName(params[i]).append("_arg"));
         ++arg_iter;
     }
 
@@ -175,107 +342,139 @@ llvm::Value *CodeGen::generateFunctionStatement(FunctionStmtAST *func_stmt){
         stmt = func_stmt->getStatement(i);
         if (!stmt){
             break;
-        }else if (!llvm::isa<NULLExprAST>(stmt)){
-            v = generateStatement(stmt);
         }
+        v = generateStatement(stmt);
     }
     return v;
 }
 
 /**
  * Method of generating variable declaration
+ * The alloca is registered in VariableSlots, where references to the
+ * declaration find it. Parameters come first in the order of the
+ * arguments, each of which is stored to its alloca.
+ * In SSA mode nothing is emitted: a parameter starts as its argument
+ * and a local as undef
  */
-llvm::Value *CodeGen::generateStatement(VariableDeclAST *vdecl){
+llvm::Value *CodeGen::generateVariableDeclaration(VariableDeclAST *vdecl){
+    if (SSA){
+        llvm::Value *init;
+        if (vdecl->getType() == VariableDeclAST::param){
+            init = NextArg;
+            ++NextArg;
+        }else{
+            init = llvm::UndefValue::get(llvm::Type::getInt32Ty(llvm::getGlobalContext()));
+        }
+        writeVariable(vdecl, init);
+        return init;
+    }
+
     //Create alloca
     llvm::AllocaInst *alloca = Builder->CreateAlloca(
             llvm::Type::getInt32Ty(llvm::getGlobalContext()),
             0,
-            vdecl->getName()
+            Symbols->getString(vdecl->getName())
             );
+    VariableSlots[vdecl] = alloca;
 
     //If args alloca
     if (vdecl->getType() == VariableDeclAST::param){
         //store args
-        llvm::ValueSymbolTable *vs_table = CurFunc->getValueSymbolTable();
-        Builder->CreateStore(vs_table.lookup(vdecl->getName().append("_arg")), alloca);
+        Builder->CreateStore(NextArg, alloca);
+        ++NextArg;
+        ArgumentStores++;
     }
     
     return alloca;
 }
 
 /**
- * Method of generating statement
- * @param JumpStmtAST
+ * Statement
+ * @return Value of the statement, NULL if it is not an expression
  */
 llvm::Value *CodeGen::generateStatement(BaseAST *stmt){
-    if (llvm::isa<BinaryExprAST>(stmt)){
-        return generateBinaryExpression(llvm::dyn_cast<BinaryExprAST>(stmt));
-    }else if (llvm::isa<CallExprAST>(stmt)){
-        return generateCallExpression(llvm::dyn_cast<CallExprAST>(stmt));
-    }else if (llvm::isa<JumpStmtAST>(stmt)){
-        return generateJumpStatement(llvm::dyn_cast<JumpStmtAST>(stmt));
-    }else{
-        return NULL;
+    llvm::Value *v;
+    switch (stmt->getValueID()){
+        case BinaryExprID:
+        case CallExprID:
+        case JumpStmtID:
+            //The tree is walked in post order with an explicit stack, so the
+            //depth of an expression does not consume the C++ stack
+            return walk(stmt, v) ? v : NULL;
+        default:
+            return NULL;
     }
 }
 
 /**
- * Binary Expression
+ * Methods called by walk() for each node, whose operands are already
+ * generated
+ * @return success: true (Value in v) fail: false
  */
-llvm::Value *CodeGen::generateBinaryExpression(BinaryExprAST *bin_expr){
-    BaseAST *lhs = bin_expr->getLHS();
-    BaseAST *rhs = bin_expr->getRHS();
-
-    llvm::Value *lhs_v;
-    llvm::Value *rhs_v;
-
-    //assignment
-    if (bin_expr->getOp() == "="){
-        //lhs is variable
-        VariableAST *lhs_var = llvm::dyn_cast<VariableAST>(lhs);
-        llvm::ValueSymbolTable &vs_table = CurFunc->getValueSymbolTable();
-        lhs_v = vs_table.lookup(lhs_var->getName());
-    
-    //Other operand
-    }else{
-        //lhs is
-        //Binary?
-        if (llvm::isa<BinaryExprAST>(lhs)){
-            lhs_v = generateBinaryExpression(llvm::dyn_cast<BinaryExprAST>(lhs));
-
-        //Variable?
-        }else if (llvm::isa<VariableAST>(lhs)){
-            lhs_v = generateVariable(llvm::dyn_cast<VariableAST>(lhs));
-
-        //Number?
-        }else if (llvm::isa<NumberAST>(lhs)){
-            NumberAST *num = llvm::dyn_cast<NumberAST>(lhs);
-            lhs_v = generateNumber(num->getNumberValue());
-        }
-    }
+bool CodeGen::visitVariableDecl(VariableDeclAST *vdecl, llvm::ArrayRef<llvm::Value*>, llvm::Value *&v){
+    v = generateVariableDeclaration(vdecl);
+    return v != NULL;
+}
+
+bool CodeGen::visitBinaryExpr(BinaryExprAST *bin_expr, llvm::ArrayRef<llvm::Value*> operands, llvm::Value *&v){
+    if (bin_expr->getOp() == "=")
+        v = generateAssignment(bin_expr, operands[0]);
+    else
+        v = generateBinaryExpression(bin_expr, operands[0], operands[1]);
+    return v != NULL;
+}
+
+bool CodeGen::visitNullExpr(NullExprAST*, llvm::ArrayRef<llvm::Value*>, llvm::Value *&v){
+    //Generates nothing
+    v = NULL;
+    return true;
+}
 
-    //Create rhs value
-    if (llvm::isa<BinaryExprAST>(rhs)){
-        rhs_v = generateBinaryExpression(llvm::dyn_cast<BinaryExprAST>(rhs));
+bool CodeGen::visitCallExpr(CallExprAST *call_expr, llvm::ArrayRef<llvm::Value*> operands, llvm::Value *&v){
+    v = generateCallExpression(call_expr, operands);
+    return v != NULL;
+}
+
+bool CodeGen::visitJumpStmt(JumpStmtAST *jump_stmt, llvm::ArrayRef<llvm::Value*> operands, llvm::Value *&v){
+    v = generateJumpStatement(jump_stmt, operands[0]);
+    return v != NULL;
+}
 
-    //CallExpr
-    }else if (llvm::isa<CallExprAST>(rhs)){
-        rhs_v = generateCallExpression(llvm::dyn_cast<CallExprAST>(rhs));
+bool CodeGen::visitVariable(VariableAST *var, llvm::ArrayRef<llvm::Value*>, llvm::Value *&v){
+    v = generateVariable(var);
+    return v != NULL;
+}
 
-    //Variable
-    }else if (llvm::isa<VariableAST>(rhs)){
-        rhs_v = generateVariable(llvm::dyn_cast<VariableAST>(rhs));
+bool CodeGen::visitNumber(NumberAST *num, llvm::ArrayRef<llvm::Value*>, llvm::Value *&v){
+    v = generateNumber(num->getNumberValue());
+    return v != NULL;
+}
 
-    //Number
-    }else if (llvm::isa<NumberAST>(rhs)){
-        NumberAST *num = llvm::dyn_cast<NumberAST>(rhs);
-        rhs_v = generateNumber(num->getNumberValue());
+/**
+ * Assignment
+ * @return Value assigned
+ */
+llvm::Value *CodeGen::generateAssignment(BinaryExprAST *bin_expr, llvm::Value *rhs_v){
+    //lhs is variable
+    VariableAST *lhs_var = llvm::dyn_cast<VariableAST>(bin_expr->getLHS());
+    if (SSA){
+        writeVariable(lhs_var->getDecl(), rhs_v);
+        return rhs_v;
     }
+    llvm::Value *lhs_v = VariableSlots.lookup(lhs_var->getDecl());
+    SlotLookups++;
+
+    //store
+    Builder->CreateStore(rhs_v, lhs_v);
+    return rhs_v;
+}
 
-    if (bin_expr->getOp() == "="){
-        //store
-        return Builder->CreateStore(rhs_v, lhs_v);
-    }else if (bin_expr->getOp() == "+"){
+/**
+ * Binary Expression
+ */
+llvm::Value *CodeGen::generateBinaryExpression(BinaryExprAST *bin_expr,
+        llvm::Value *lhs_v, llvm::Value *rhs_v){
+    if (bin_expr->getOp() == "+"){
         return Builder->CreateAdd(lhs_v, rhs_v, "add_tmp");
     }else if (bin_expr->getOp() == "-"){
         return Builder->CreateSub(lhs_v, rhs_v, "sub_tmp");
@@ -284,82 +483,176 @@ llvm::Value *CodeGen::generateBinaryExpression(BinaryExprAST *bin_expr){
     }else if (bin_expr->getOp() == "/"){
         return Builder->CreateSDiv(lhs_v, rhs_v, "div_tmp");
     }
+    return NULL;
 }
 
 /**
  * Method of generating Function Call
  */
-llvm::Value *CodeGen::generateCallExpression(CallExprAST *call_expr){
-    std::vector<llvm::Value*> arg_vec;
-    BaseAST *arg;
-    llvm::Value *arg_v;
-    llvm::ValueSymbolTable &vs_table = CurFunc->getValueSymbolTable();
-    for (int i=0; ; i++){
-        if (!(arg = call_expr-getArgs(i))){
-            break;
-        }
+llvm::Value *CodeGen::generateCallExpression(CallExprAST *call_expr,
+        llvm::ArrayRef<llvm::Value*> args){
+    CallEdges.push_back(std::make_pair(CurName, call_expr->getCallee()));
+    return Builder->CreateCall(getFunction(call_expr->getCallee()),
+            args, "call_tmp");
+}
 
-        //isCall
-        if (llvm::isa<CallExprAST>(arg)){
-            arg_v = generateCallExpression(llvm::dyn_cast<CallExprAST>(arg));
-        }
+/**
+ * Generating Jump
+ */
+llvm::Value *CodeGen::generateJumpStatement(JumpStmtAST*, llvm::Value *ret_v){
+    return Builder->CreateRet(ret_v);
+}
 
-        //isBinaryExpr
-        else if (llvm::isa<BinaryExprAST>(arg)){
-            BinaryExprAST *bin_expr = llvm::dyn_cast<BinaryExprAST>(arg);
+/**
+ * Generate Reference of Variable
+ */
+llvm::Value *CodeGen::generateVariable(VariableAST *var){
+    if (SSA)
+        return readVariable(var->getDecl());
+    SlotLookups++;
+    return Builder->CreateLoad(VariableSlots.lookup(var->getDecl()), "var_tmp");
+}
 
-            arg_v = generateBinaryExpression(llvm::dyn_cast<BinaryExprAST>(arg));
+/**
+ * Method of Module generation from FlatAST
+ */
+bool CodeGen::generateFlatTranslationUnit(FlatAST &flat, std::string name){
+    Mod = new llvm::Module(name, llvm::getGlobalContext());
+    Symbols = flat.getSymbols();
+    Functions.assign(Symbols->size(), NULL);
+    CallEdges.clear();
 
-            if (bin_expr->getOp() == "="){
-                VariableAST *var = llvm::dyn_cast<VariableAST>(bin_expr->getLHS());
-                arg_v = Builder->CreateLoad(vs_table.lookup(var->getName()), "arg_val");
-            }
+    //Function declaration
+    for (int i=0; i<flat.getNumPrototypes(); i++){
+        FlatFunction &proto = flat.getPrototype(i);
+        if (!declareFunction(proto.Name, flat.getParams(proto), Mod)){
+            SAFE_DELETE(Mod);
+            return false;
         }
+    }
 
-        //isVar
-        else if (llvm::isa<VariableAST>(arg)){
-            arg_v = generateVariable(llvm::dyn_cast<VariableAST>(arg));
+    //Function definition
+    for (int i=0; i<flat.getNumFunctions(); i++){
+        if (!generateFlatFunction(flat, flat.getFunction(i))){
+            SAFE_DELETE(Mod);
+            return false;
         }
+    }
 
-        //isNumber
-        else if (llvm::isa<NumberAST>(arg)){
-            NumberAST *num = llvm::dyn_cast<NumberAST>(arg);
-            arg_v = generateNumber(num->getNumberValue());
-        }
+    return true;
+}
+
+/**
+ * Method of function definition from FlatAST
+ * The body is generated by one pass over its nodes; as children precede
+ * their parents, the operands of a node are already in FlatValues
+ * @return Pointer of generated Function
+ */
+llvm::Function *CodeGen::generateFlatFunction(FlatAST &flat, FlatFunction &func_info){
+    llvm::Function *func = declareFunction(func_info.Name, flat.getParams(func_info), Mod);
+    if (!func){
+        return NULL;
+    }
+    CurFunc = func;
+    CurName = func_info.Name;
+    llvm::BasicBlock *bblock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "entry", func);
+    Builder->SetInsertPoint(bblock);
 
-        arg_vec.push_back(arg_v);
+    //Slots, storing the arguments to the parameters
+    llvm::ArrayRef<SymbolID> slots = flat.getSlots(func_info);
+    llvm::Function::arg_iterator arg_iter = func->arg_begin();
+    FlatSlots.resize(slots.size());
+    for (int i=0; i<slots.size(); i++){
+        FlatSlots[i] = Builder->CreateAlloca(
+                llvm::Type::getInt32Ty(llvm::getGlobalContext()), 0, Symbols->getString(slots[i]));
+        if (i < func_info.NumParams){
+            Builder->CreateStore(arg_iter, FlatSlots[i]);
+            ++arg_iter;
+        }
+    }
 
+    //Nodes
+    unsigned base = func_info.NodeBegin;
+    FlatValues.resize(func_info.NodeEnd - base);
+    for (unsigned node=base; node<func_info.NodeEnd; node++){
+        uint32_t a = flat.getA(node);
+        uint32_t b = flat.getB(node);
+        llvm::Value *v = NULL;
+
+        switch (flat.getOp(node)){
+            case FLAT_NUMBER:
+                v = generateNumber(flat.getNumberValue(node));
+                break;
+            case FLAT_VAR_LOAD:
+                v = Builder->CreateLoad(FlatSlots[a], "var_tmp");
+                break;
+            case FLAT_VAR_REF:
+                v = FlatSlots[a];
+                break;
+            case FLAT_ASSIGN:
+                //value of assignment is the assigned value
+                Builder->CreateStore(FlatValues[b - base], FlatValues[a - base]);
+                v = FlatValues[b - base];
+                break;
+            case FLAT_ADD:
+                v = Builder->CreateAdd(FlatValues[a - base], FlatValues[b - base], "add_tmp");
+                break;
+            case FLAT_SUB:
+                v = Builder->CreateSub(FlatValues[a - base], FlatValues[b - base], "sub_tmp");
+                break;
+            case FLAT_MUL:
+                v = Builder->CreateMul(FlatValues[a - base], FlatValues[b - base], "mul_tmp");
+                break;
+            case FLAT_DIV:
+                v = Builder->CreateSDiv(FlatValues[a - base], FlatValues[b - base], "div_tmp");
+                break;
+            case FLAT_CALL: {
+                llvm::ArrayRef<uint32_t> args = flat.getArgs(node);
+                std::vector<llvm::Value*> arg_vec(args.size());
+                for (int i=0; i<args.size(); i++)
+                    arg_vec[i] = FlatValues[args[i] - base];
+                v = Builder->CreateCall(getFunction(a), arg_vec, "call_tmp");
+                CallEdges.push_back(std::make_pair(CurName, (SymbolID)a));
+                break;
+            }
+            case FLAT_RETURN:
+                v = Builder->CreateRet(FlatValues[a - base]);
+                break;
+        }
+        FlatValues[node - base] = v;
     }
 
-    return Builder->CreateCall(Mod->getFunction(call_expr->getCallee()),
-            arg_vec, "call_tmp");
+    return func;
 }
 
 /**
- * Generating Jump
+ * Get function declared for SymbolID
+ * @return llvm::Function, NULL if not declared yet
  */
-llvm::Value *CodeGen::generateJumpStatement(JumpStmtAST *jump_stmt){
-    BaseAST *expr = jump_stmt->getExpr();
-    llvm::Value *ret_v;
-    if (llvm::isa<BinaryExprAST>(expr)){
-        ret_v = generateBinaryExpression(llvm::dyn_cast<BinaryExprAST>(expr));
-    }else if (llvm::isa<VariableAST>(expr)){
-        VariableAST *var = llvm::dyn_cast<VariableAST>(expr);
-        ret_v = generateVariable(var);
-    }else if (llvm::isa<NumberAST>(expr)){
-        NumberAST *num = llvm::dyn_cast<NumberAST>(expr);
-        ret_v = generateNumber(num->getNumberValue());
-    }
+llvm::Function *CodeGen::getFunction(SymbolID name){
+    if (name < Functions.size())
+        return Functions[name];
+    return NULL;
+}
 
-    Builder->CreateRet(ret_v);
+/**
+ * Record value as the current definition of the variable (SSA)
+ * Following Braun et al., "Simple and Efficient SSA Construction", the
+ * definitions are numbered locally in the block being generated
+ */
+bool CodeGen::writeVariable(VariableDeclAST *vdecl, llvm::Value *value){
+    CurrentDefs[vdecl] = value;
+    return true;
 }
 
 /**
- * Generate Reference of Variable
+ * Current definition of the variable (SSA)
+ * DummyC has no control flow, so a function is the single block "entry"
+ * and every variable is defined in it by its declaration; the lookup in
+ * predecessors and the phis of the global case are never needed
  */
-llvm::Value *CodeGen::generateVariable(VariableAST *var){
-    llvm::ValueSymbolTable &vs_table = CurFunc->getValueSymbolTable();
-    return Builder->CreateLoad(vs_table.lookup(var->getName()), "var_tmp");
+llvm::Value *CodeGen::readVariable(VariableDeclAST *vdecl){
+    return CurrentDefs.lookup(vdecl);
 }
 
 llvm::Value *CodeGen::generateNumber(int value){
@@ -369,13 +662,23 @@ llvm::Value *CodeGen::generateNumber(int value){
             );
 }
 
+/**
+ * Link a file of LLVM IR (.ll) or bitcode (.bc) into dest
+ * @return success: true fail: false
+ */
 bool CodeGen::linkModule(llvm::Module *dest, std::string file_name){
     llvm::SMDiagnostic err;
-    llvm::Module *link_mod = llvm::ParseIRFile(file_name, err, llvm::getGlobalContext());
+    //Bitcode is read lazily, textual IR at once
+    llvm::Module *link_mod = llvm::getLazyIRFileModule(file_name, err, llvm::getGlobalContext());
     if (!link_mod){
         return false;
     }
 
+    if (!materializeReferenced(dest, link_mod)){
+        SAFE_DELETE(link_mod);
+        return false;
+    }
+
     std::string err_msg;
     if (llvm::Linker::LinkModules(dest, link_mod, llvm::Linker::DestroySource, &err_msg)){
         return false;
@@ -385,3 +688,95 @@ bool CodeGen::linkModule(llvm::Module *dest, std::string file_name){
 
     return true;
 }
+
+
+/**
+ * Read the bodies of the functions of lazily loaded link_mod that the
+ * declarations of dest, the initializers of the global variables and the
+ * aliases reach, and drop the unread ones nothing refers to, so that the
+ * Linker does not read them either
+ * @return success: true fail: false
+ */
+bool CodeGen::materializeReferenced(llvm::Module *dest, llvm::Module *link_mod){
+    std::vector<llvm::Function*> worklist;
+    llvm::DenseSet<llvm::Constant*> visited;
+    std::string err_msg;
+
+    for (llvm::Module::iterator func = dest->begin(); func != dest->end(); ++func){
+        if (!func->isDeclaration())
+            continue;
+        llvm::Function *def = link_mod->getFunction(func->getName());
+        if (def && def->isMaterializable()){
+            if (def->Materialize(&err_msg))
+                return false;
+            worklist.push_back(def);
+        }
+    }
+
+    //The Linker takes every global variable and alias of link_mod
+    for (llvm::Module::global_iterator var = link_mod->global_begin(); var != link_mod->global_end(); ++var){
+        if (var->hasInitializer() && !materializeConstant(var->getInitializer(), worklist, visited))
+            return false;
+    }
+    for (llvm::Module::alias_iterator alias = link_mod->alias_begin(); alias != link_mod->alias_end(); ++alias){
+        if (!materializeConstant(alias->getAliasee(), worklist, visited))
+            return false;
+    }
+
+    //Functions referred to from the bodies read
+    while (!worklist.empty()){
+        llvm::Function *func = worklist.back();
+        worklist.pop_back();
+        for (llvm::Function::iterator bb = func->begin(); bb != func->end(); ++bb){
+            for (llvm::BasicBlock::iterator inst = bb->begin(); inst != bb->end(); ++inst){
+                for (int i=0; i<inst->getNumOperands(); i++){
+                    llvm::Constant *operand = llvm::dyn_cast<llvm::Constant>(inst->getOperand(i));
+                    if (operand && !materializeConstant(operand, worklist, visited))
+                        return false;
+                }
+            }
+        }
+    }
+
+    for (llvm::Module::iterator it = link_mod->begin(); it != link_mod->end(); ){
+        llvm::Function *func = it++;
+        if (func->isMaterializable() && func->use_empty())
+            func->eraseFromParent();
+    }
+    return true;
+}
+
+/**
+ * Read the bodies of the functions that constant refers to, through the
+ * operands of constant expressions and aggregates, and add them to
+ * worklist; other globals are not entered, their initializers are seeds
+ * @return success: true fail: false
+ */
+bool CodeGen::materializeConstant(llvm::Constant *constant, std::vector<llvm::Function*> &worklist,
+        llvm::DenseSet<llvm::Constant*> &visited){
+    std::vector<llvm::Constant*> constants(1, constant);
+    std::string err_msg;
+    while (!constants.empty()){
+        llvm::Constant *c = constants.back();
+        constants.pop_back();
+        if (!visited.insert(c).second)
+            continue;
+
+        if (llvm::Function *func = llvm::dyn_cast<llvm::Function>(c)){
+            if (func->isMaterializable()){
+                if (func->Materialize(&err_msg))
+                    return false;
+                worklist.push_back(func);
+            }
+            continue;
+        }
+        if (llvm::isa<llvm::GlobalValue>(c))
+            continue;
+        for (int i=0; i<c->getNumOperands(); i++){
+            llvm::Constant *operand = llvm::dyn_cast<llvm::Constant>(c->getOperand(i));
+            if (operand)
+                constants.push_back(operand);
+        }
+    }
+    return true;
+}
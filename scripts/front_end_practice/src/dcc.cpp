@@ -1,17 +1,25 @@
+#include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/IR/IRPrintingPasses.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/LinkAllPasses.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/TargetSelect.h"
 #include "lexer.hpp"
 #include "AST.hpp"
+#include "ASTSimplifier.hpp"
+#include "FlatAST.hpp"
 #include "parser.hpp"
 #include "codegen.hpp"
+#include "optimizer.hpp"
+#include "emitter.hpp"
+#include "interpreter.hpp"
+#include "tiercompiler.hpp"
 
 
 /**
@@ -23,16 +31,54 @@ class OptionParser{
         std::string OutputFileName;
         std::string LinkFileName;
         bool WithJit;
+        bool Interp;
+        bool Tiered;
+        long TierThreshold;
+        int JitThreads;
+        std::string JitCacheDir;
+        long JitCacheMegabytes;
+        bool StreamLex;
+        bool FlatCodeGen;
+        bool DirectSSA;
+        bool Simplify;
+        long EvalBudget;
+        int OptLevel;
+        std::string Passes;
+        bool EmitAssembly;
+        bool EmitObject;
+        bool EmitBitcode;
+        std::string MArch;
+        std::string MCpu;
+        int Threads;
         int Argc;
         char **Argv;
 
     public:
-        OptionParser(int argc, char **argv): Argc(argc), Argv(argv), WithJit(false){}
+        OptionParser(int argc, char **argv): Argc(argc), Argv(argv), WithJit(false), Interp(false), Tiered(false), TierThreshold(DefaultTierUpThreshold), JitThreads(0), JitCacheMegabytes(DefaultJITCacheMegabytes), StreamLex(false), FlatCodeGen(false), DirectSSA(false), Simplify(true), EvalBudget(DefaultEvalBudget), OptLevel(0), EmitAssembly(false), EmitObject(false), EmitBitcode(false), Threads(1){}
         void printHelp();
         std::string getInputFileName(){return InputFileName;}
         std::string getOutputFileName(){return OutputFileName;}
-        std::string getLinKFileName(){return LinkFileName;}
+        std::string getLinkFileName(){return LinkFileName;}
         bool getWithJit(){return WithJit;}
+        bool getInterp(){return Interp;}
+        bool getTiered(){return Tiered;}
+        long getTierThreshold(){return TierThreshold;}
+        int getJitThreads(){return JitThreads;}
+        std::string getJitCacheDir(){return JitCacheDir;}
+        long getJitCacheMegabytes(){return JitCacheMegabytes;}
+        bool getStreamLex(){return StreamLex;}
+        bool getFlatCodeGen(){return FlatCodeGen;}
+        bool getDirectSSA(){return DirectSSA;}
+        bool getSimplify(){return Simplify;}
+        long getEvalBudget(){return EvalBudget;}
+        int getOptLevel(){return OptLevel;}
+        std::string getPasses(){return Passes;}
+        bool getEmitAssembly(){return EmitAssembly;}
+        bool getEmitObject(){return EmitObject;}
+        bool getEmitBitcode(){return EmitBitcode;}
+        std::string getMArch(){return MArch;}
+        std::string getMCpu(){return MCpu;}
+        int getThreads(){return Threads;}
         bool parseOption();
 
 };
@@ -42,7 +88,33 @@ class OptionParser{
  */
 void OptionParser::printHelp(){
     fprintf(stdout, "Compiler for DummyC...\n");
-    fprintf(stdout, "LLVM 3.5 for MacOS/X")
+    fprintf(stdout, "LLVM 3.5 for MacOS/X\n");
+    fprintf(stdout, "  -interp     run main on the bytecode interpreter, without LLVM\n");
+    fprintf(stdout, "  -tiered     run main on the bytecode interpreter and compile the hot\n");
+    fprintf(stdout, "              functions at -O%d on a background thread\n", TierOptLevel);
+    fprintf(stdout, "  -tier-threshold N  calls of a function before -tiered compiles it\n");
+    fprintf(stdout, "                     (default %u)\n", DefaultTierUpThreshold);
+    fprintf(stdout, "  -jit-threads N  with -jit, compile the callees of compiled functions\n");
+    fprintf(stdout, "                  on N background threads (default 0)\n");
+    fprintf(stdout, "  -jit-cache DIR  with -jit, keep compiled objects in DIR across runs\n");
+    fprintf(stdout, "  -jit-cache-size MB  size limit of -jit-cache (default %ld)\n", DefaultJITCacheMegabytes);
+    fprintf(stdout, "  -flat       generate code from the flat AST\n");
+    fprintf(stdout, "  -ssa        build SSA values directly instead of running mem2reg\n");
+    fprintf(stdout, "  -no-simplify  generate code from the AST as parsed\n");
+    fprintf(stdout, "  -eval-budget N  steps to evaluate a pure call with constant arguments\n");
+    fprintf(stdout, "                  at compile time (default %ld, 0 disables)\n", DefaultEvalBudget);
+    fprintf(stdout, "  -O0 .. -O%d  optimization level of the output and -jit (default -O0)\n", MaxOptLevel);
+    fprintf(stdout, "  -passes=a,b,c  run these passes instead of the -O pipeline, out of\n");
+    fprintf(stdout, "                 ");
+    Optimizer::printPassNames(stdout);
+    fprintf(stdout, "  -S          write native assembly instead of LLVM IR\n");
+    fprintf(stdout, "  -c          write a native object file (default output file.o)\n");
+    fprintf(stdout, "  -emit-bc    write LLVM bitcode (default output file.bc)\n");
+    fprintf(stdout, "  -l file     link LLVM IR or bitcode; of bitcode only the functions\n");
+    fprintf(stdout, "              the program reaches are read\n");
+    fprintf(stdout, "  -march=A    architecture of -S and -c (default host)\n");
+    fprintf(stdout, "  -mcpu=C     CPU of -S and -c, \"native\" for the host CPU\n");
+    fprintf(stdout, "  -threads N  parse function bodies on N threads\n");
 }
 
 /**
@@ -64,6 +136,64 @@ bool OptionParser::parseOption(){
             LinkFileName.assign(Argv[++i]);
         }else if (Argv[i][0] == '-' && Argv[i][1] == 'j' && Argv[i][2] == 'i' && Argv[i][3] == 't' && Argv[i][4] == '\0'){
             WithJit = true;
+        }else if (strcmp(Argv[i], "-interp") == 0){
+            Interp = true;
+        }else if (strcmp(Argv[i], "-tiered") == 0){
+            Tiered = true;
+        }else if (strcmp(Argv[i], "-tier-threshold") == 0 && i + 1 < Argc){
+            TierThreshold = atol(Argv[++i]);
+            if (TierThreshold < 1 || TierThreshold > UINT_MAX){
+                fprintf(stderr, "-tier-threshold needs a positive number of calls\n");
+                return false;
+            }
+        }else if (strcmp(Argv[i], "-jit-threads") == 0 && i + 1 < Argc){
+            JitThreads = atoi(Argv[++i]);
+            if (JitThreads < 0){
+                fprintf(stderr, "-jit-threads needs a number of threads\n");
+                return false;
+            }
+        }else if (strcmp(Argv[i], "-jit-cache") == 0 && i + 1 < Argc){
+            JitCacheDir.assign(Argv[++i]);
+        }else if (strcmp(Argv[i], "-jit-cache-size") == 0 && i + 1 < Argc){
+            JitCacheMegabytes = atol(Argv[++i]);
+            if (JitCacheMegabytes < 1){
+                fprintf(stderr, "-jit-cache-size needs a positive number of megabytes\n");
+                return false;
+            }
+        }else if (strcmp(Argv[i], "-stream") == 0){
+            StreamLex = true;
+        }else if (strcmp(Argv[i], "-flat") == 0){
+            FlatCodeGen = true;
+        }else if (strcmp(Argv[i], "-ssa") == 0){
+            DirectSSA = true;
+        }else if (strcmp(Argv[i], "-no-simplify") == 0){
+            Simplify = false;
+        }else if (strcmp(Argv[i], "-eval-budget") == 0 && i + 1 < Argc){
+            EvalBudget = atol(Argv[++i]);
+            if (EvalBudget < 0){
+                fprintf(stderr, "-eval-budget needs a number of steps\n");
+                return false;
+            }
+        }else if (Argv[i][0] == '-' && Argv[i][1] == 'O' && Argv[i][2] >= '0' && Argv[i][2] <= '0' + MaxOptLevel && Argv[i][3] == '\0'){
+            OptLevel = Argv[i][2] - '0';
+        }else if (strncmp(Argv[i], "-passes=", 8) == 0){
+            Passes.assign(Argv[i] + 8);
+        }else if (strcmp(Argv[i], "-S") == 0){
+            EmitAssembly = true;
+        }else if (strcmp(Argv[i], "-c") == 0){
+            EmitObject = true;
+        }else if (strcmp(Argv[i], "-emit-bc") == 0){
+            EmitBitcode = true;
+        }else if (strncmp(Argv[i], "-march=", 7) == 0){
+            MArch.assign(Argv[i] + 7);
+        }else if (strncmp(Argv[i], "-mcpu=", 6) == 0){
+            MCpu.assign(Argv[i] + 6);
+        }else if (strcmp(Argv[i], "-threads") == 0 && i + 1 < Argc){
+            Threads = atoi(Argv[++i]);
+            if (Threads < 1){
+                fprintf(stderr, "-threads needs a positive number\n");
+                return false;
+            }
         }else if (Argv[i][0] == '-'){
             fprintf(stderr, "%s is unknown option\n", Argv[i]);
             return false;
@@ -72,15 +202,31 @@ bool OptionParser::parseOption(){
         }
     }
 
+    if (Interp && (WithJit || EmitAssembly || EmitObject || EmitBitcode)){
+        fprintf(stderr, "-interp cannot be used with -jit, -S, -c or -emit-bc\n");
+        return false;
+    }
+    if (Tiered && (Interp || WithJit || EmitAssembly || EmitObject || EmitBitcode)){
+        fprintf(stderr, "-tiered cannot be used with -interp, -jit, -S, -c or -emit-bc\n");
+        return false;
+    }
+    if (TierThreshold != DefaultTierUpThreshold && !Tiered)
+        fprintf(stderr, "-tier-threshold is ignored without -tiered\n");
+    if (EmitAssembly + EmitObject + EmitBitcode > 1){
+        fprintf(stderr, "-S, -c and -emit-bc cannot be used together\n");
+        return false;
+    }
+
     //OutputFileName
     std::string ifn = InputFileName;
     int len = ifn.length();
+    const char *suffix = EmitObject ? ".o" : EmitBitcode ? ".bc" : ".s";
     if (OutputFileName.empty() && (len > 2) && ifn[len-3] == '.' && ((ifn[len-2] == 'd' && ifn[len-1] == 'c'))){
         OutputFileName = std::string(ifn.begin(), ifn.end() - 3);
-        OutputFileName += ".s";
+        OutputFileName += suffix;
     }else if (OutputFileName.empty()){
         OutputFileName = ifn;
-        OutputFileName += ".s";
+        OutputFileName += suffix;
     }
 
     return true;
@@ -90,9 +236,8 @@ bool OptionParser::parseOption(){
  * main function
  */
 int main(int argc, char **argv){
-    llvm::InitializeNativeTarget();
     llvm::sys::PrintStackTraceOnErrorSignal();
-    llvm::PrettyStackTraceProgram X(argc, argv)
+    llvm::PrettyStackTraceProgram X(argc, argv);
 
     llvm::EnableDebugBuffering = true;
 
@@ -106,8 +251,18 @@ int main(int argc, char **argv){
         exit(1);
     }
 
-    Parser *parser = new Parser(opt.getInputFileName());
-    if (!parser->doParse()){
+    //Pass pipeline (-passes= takes precedence over -O)
+    Optimizer optimizer;
+    if (opt.getPasses().empty()){
+        optimizer.setOptLevel(opt.getOptLevel());
+    }else if (!optimizer.setPasses(opt.getPasses())){
+        exit(1);
+    }
+
+    Parser *parser = new Parser(opt.getInputFileName(), opt.getStreamLex());
+    if (opt.getThreads() > 1 && !parser->setThreads(opt.getThreads()))
+        fprintf(stderr, "-threads is ignored with -stream\n");
+    if (!parser->doParser()){
         fprintf(stderr, "Error at parser or lexer\n");
         SAFE_DELETE(parser);
         exit(1);
@@ -120,11 +275,94 @@ int main(int argc, char **argv){
         exit(1);
     }
 
-    CodeGene *codegen = new CodeGen();
-    if (!codegen->doCodeGen(tunit, opt.getInputFileName(), opt.getLinkFileName(), opt.getWithJit())){
+    //Constant folding, algebraic identities and evaluation of pure calls
+    if (opt.getSimplify() && !simplifyAST(tunit, opt.getEvalBudget())){
+        fprintf(stderr, "Error at simplifier\n");
+        SAFE_DELETE(parser);
+        exit(1);
+    }
+
+    //Interpretation, without setting up LLVM
+    if (opt.getInterp()){
+        if (!opt.getLinkFileName().empty())
+            fprintf(stderr, "-l is ignored with -interp\n");
+        Interpreter interp;
+        int result;
+        if (!interp.load(tunit) || !interp.run(result)){
+            fprintf(stderr, "Error at interpreter\n");
+            SAFE_DELETE(parser);
+            exit(1);
+        }
+        fprintf(stderr, "%d\n", result);
+        SAFE_DELETE(parser);
+        return 0;
+    }
+
+    //Interpretation, compiling the hot functions in the background
+    if (opt.getTiered()){
+        if (!opt.getLinkFileName().empty())
+            fprintf(stderr, "-l is ignored with -tiered\n");
+        Interpreter interp;
+        if (!interp.load(tunit)){
+            fprintf(stderr, "Error at interpreter\n");
+            SAFE_DELETE(parser);
+            exit(1);
+        }
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        TierCompiler *tier = new TierCompiler(tunit, &interp, opt.getTierThreshold());
+        tier->start();
+        interp.setTierUp(tier, opt.getTierThreshold());
+        int result;
+        bool ran = interp.run(result);
+        tier->stop();
+        if (!ran){
+            fprintf(stderr, "Error at interpreter\n");
+            SAFE_DELETE(tier);
+            SAFE_DELETE(parser);
+            exit(1);
+        }
+        fprintf(stderr, "%d\n", result);
+        fprintf(stderr, "tiers: %ld tier-ups, %ld functions native\n", tier->getTierUps(), tier->getNativeFunctions());
+        SAFE_DELETE(tier);
+        SAFE_DELETE(parser);
+        return 0;
+    }
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    CodeGen *codegen = new CodeGen();
+    bool generated;
+    bool direct_ssa = opt.getDirectSSA() && !opt.getFlatCodeGen();
+    if (opt.getDirectSSA() && opt.getFlatCodeGen())
+        fprintf(stderr, "-ssa is ignored with -flat\n");
+    codegen->setSSA(direct_ssa);
+    optimizer.setDirectSSA(direct_ssa);
+    codegen->setOptimizer(&optimizer);
+    if (opt.getJitThreads() > 0 && !opt.getWithJit())
+        fprintf(stderr, "-jit-threads is ignored without -jit\n");
+    JITObjectCache *jit_cache = NULL;
+    if (!opt.getJitCacheDir().empty() && !opt.getWithJit()){
+        fprintf(stderr, "-jit-cache is ignored without -jit\n");
+    }else if (!opt.getJitCacheDir().empty()){
+        if (opt.getJitThreads() > 0)
+            fprintf(stderr, "-jit-threads is ignored with -jit-cache\n");
+        jit_cache = new JITObjectCache(opt.getJitCacheDir(), (uint64_t)opt.getJitCacheMegabytes() << 20);
+        codegen->setJITCache(jit_cache);
+    }
+    codegen->setJITThreads(opt.getJitThreads());
+    if (opt.getFlatCodeGen()){
+        FlatAST *flat = flattenAST(tunit);
+        generated = flat && codegen->doCodeGen(*flat, opt.getInputFileName(), opt.getLinkFileName(), opt.getWithJit());
+        SAFE_DELETE(flat);
+    }else{
+        generated = codegen->doCodeGen(tunit, opt.getInputFileName(), opt.getLinkFileName(), opt.getWithJit());
+    }
+    if (!generated){
         fprintf(stderr, "Error at codegen\n");
         SAFE_DELETE(parser);
         SAFE_DELETE(codegen);
+        SAFE_DELETE(jit_cache);
         exit(1);
     }
 
@@ -133,24 +371,49 @@ int main(int argc, char **argv){
         fprintf(stderr, "Module is empty\n");
         SAFE_DELETE(parser);
         SAFE_DELETE(codegen);
+        SAFE_DELETE(jit_cache);
         exit(1);
     }
 
-    llvm::PassManager pm;
-
-    //SSA
-    pm.add(llvm::createPromoteMemoryToRegisterPass());
-
-    //Output
-    std::string  error;
-    llvm::raw_fd_ostream raw_stream(opt.getOutputFileName().c_str(), error);
-    pm.add(createPrintModulePass(&raw_stream));
-    pm.run(mod);
-    raw_stream.close();
+    //Output (the pipeline already ran in CodeGen)
+    bool native = opt.getEmitAssembly() || opt.getEmitObject();
+    if (!native && (!opt.getMArch().empty() || !opt.getMCpu().empty()))
+        fprintf(stderr, "-march and -mcpu are ignored without -S or -c\n");
+    if (native){
+        NativeEmitter emitter;
+        if (!emitter.selectTarget(opt.getMArch(), opt.getMCpu()) ||
+                !emitter.emit(mod, opt.getOutputFileName(), opt.getEmitObject())){
+            fprintf(stderr, "Error at native code generation\n");
+            SAFE_DELETE(parser);
+            SAFE_DELETE(codegen);
+            SAFE_DELETE(jit_cache);
+            exit(1);
+        }
+    }else if (opt.getEmitBitcode()){
+        std::string error;
+        llvm::raw_fd_ostream raw_stream(opt.getOutputFileName().c_str(), error, llvm::sys::fs::F_None);
+        if (!error.empty()){
+            fprintf(stderr, "%s\n", error.c_str());
+            SAFE_DELETE(parser);
+            SAFE_DELETE(codegen);
+            SAFE_DELETE(jit_cache);
+            exit(1);
+        }
+        llvm::WriteBitcodeToFile(&mod, raw_stream);
+        raw_stream.close();
+    }else{
+        llvm::PassManager pm;
+        std::string  error;
+        llvm::raw_fd_ostream raw_stream(opt.getOutputFileName().c_str(), error);
+        pm.add(createPrintModulePass(&raw_stream));
+        pm.run(mod);
+        raw_stream.close();
+    }
 
     //delete
     SAFE_DELETE(parser);
     SAFE_DELETE(codegen);
+    SAFE_DELETE(jit_cache);
 
     return 0;
 
@@ -0,0 +1,92 @@
+#include <cstdio>
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/PassManager.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetOptions.h"
+#include "emitter.hpp"
+
+
+/**
+ * Create the TargetMachine
+ * @param march architecture (empty: host), mcpu CPU (empty: generic, "native": host)
+ * @return success: true fail: false
+ */
+bool NativeEmitter::selectTarget(const std::string &march, const std::string &mcpu){
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
+
+    llvm::Triple triple(llvm::sys::getDefaultTargetTriple());
+    std::string error;
+    const llvm::Target *target = llvm::TargetRegistry::lookupTarget(march, triple, error);
+    if (!target){
+        fprintf(stderr, "%s\n", error.c_str());
+        return false;
+    }
+
+    std::string cpu = mcpu;
+    llvm::SubtargetFeatures features;
+    if (mcpu == "native"){
+        cpu = llvm::sys::getHostCPUName();
+        llvm::StringMap<bool> host_features;
+        if (llvm::sys::getHostCPUFeatures(host_features)){
+            for (llvm::StringMap<bool>::iterator it = host_features.begin(); it != host_features.end(); ++it)
+                features.AddFeature(it->first(), it->second);
+        }
+    }
+
+    //PIC, so that objects link into position independent executables too
+    llvm::TargetOptions options;
+    SAFE_DELETE(Machine);
+    Machine = target->createTargetMachine(triple.getTriple(), cpu, features.getString(),
+            options, llvm::Reloc::PIC_, llvm::CodeModel::Default, llvm::CodeGenOpt::Default);
+    if (!Machine){
+        fprintf(stderr, "cannot create TargetMachine for %s\n", triple.getTriple().c_str());
+        return false;
+    }
+    Triple = triple.getTriple();
+    return true;
+}
+
+/**
+ * Write mod as native assembly or object file
+ * @param Module, output file name, object file (true) or assembly (false)
+ * @return success: true fail: false
+ */
+bool NativeEmitter::emit(llvm::Module &mod, const std::string &file_name, bool object){
+    if (!Machine)
+        return false;
+
+    mod.setTargetTriple(Triple);
+    if (const llvm::DataLayout *layout = Machine->getDataLayout())
+        mod.setDataLayout(layout);
+
+    std::string error;
+    llvm::raw_fd_ostream raw_stream(file_name.c_str(), error,
+            object ? llvm::sys::fs::F_None : llvm::sys::fs::F_Text);
+    if (!error.empty()){
+        fprintf(stderr, "%s\n", error.c_str());
+        return false;
+    }
+    llvm::formatted_raw_ostream stream(raw_stream);
+
+    llvm::PassManager pm;
+    pm.add(new llvm::DataLayoutPass(&mod));
+    llvm::TargetMachine::CodeGenFileType file_type = object ?
+        llvm::TargetMachine::CGFT_ObjectFile : llvm::TargetMachine::CGFT_AssemblyFile;
+    if (Machine->addPassesToEmitFile(pm, stream, file_type)){
+        fprintf(stderr, "%s cannot emit this file type\n", Triple.c_str());
+        return false;
+    }
+    pm.run(mod);
+    return true;
+}
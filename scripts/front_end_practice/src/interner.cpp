@@ -0,0 +1,30 @@
+#include "interner.hpp"
+
+
+/**
+ * Constructor
+ * Reserved symbols get the IDs of ReservedSymbol
+ */
+StringInterner::StringInterner(){
+    intern("int");
+    intern("return");
+    intern("printnum");
+    intern("i");
+}
+
+
+/**
+ * Intern a string
+ * @param identifier
+ * @return ID of the identifier (the same one for the same string)
+ */
+SymbolID StringInterner::intern(llvm::StringRef str){
+    llvm::StringMap<SymbolID>::iterator iter = Table.find(str);
+    if (iter != Table.end())
+        return iter->getValue();
+
+    SymbolID id = Strings.size();
+    Table[str] = id;
+    Strings.push_back(Table.find(str)->getKey());
+    return id;
+}
@@ -0,0 +1,513 @@
+#include <algorithm>
+#include <cstdio>
+#include "interpreter.hpp"
+#include "ASTVisitor.hpp"
+
+
+/**
+ * printnum of lib/printnum.c
+ */
+static int builtinPrintnum(const int *args, int){
+    return printf("%d\n", args[0]);
+}
+
+
+/**
+ * Converter from TranslationUnitAST to bytecode
+ * The result of each AST node is a value number; ValueRegs holds the
+ * register of each value of the statement and Live the values not
+ * consumed yet, which mirror the operand stack of walk().
+ * A variable read is the register of its slot and costs no instruction,
+ * so an assignment to the slot first copies the reads still live to
+ * their temporaries, as CodeGen loads a variable where it is read.
+ */
+class BytecodeBuilder : public PostOrderVisitor<BytecodeBuilder, uint32_t>{
+    friend class ASTVisitor<BytecodeBuilder, bool, llvm::ArrayRef<uint32_t>, uint32_t&>;
+
+    private:
+        static const unsigned MaxRegisters = 1 << 16;
+
+        Interpreter *Interp;
+        StringInterner *Symbols;
+        std::vector<int> SlotOf;            //Slot of variable indexed by SymbolID (-1 if none)
+        std::vector<uint16_t> ValueRegs;
+        std::vector<uint32_t> Live;
+        std::vector<uint16_t> ArgRegs;
+        unsigned NumSlots;
+        unsigned NumRegisters;
+        SymbolID CurName;
+
+    public:
+        BytecodeBuilder(Interpreter *interp, StringInterner *symbols)
+            : Interp(interp), Symbols(symbols), NumSlots(0), NumRegisters(0), CurName(0){
+            SlotOf.assign(symbols->size(), -1);
+        }
+        bool addFunction(FunctionAST *func_ast, BytecodeFunction &func);
+
+    private:
+        unsigned popOperands(llvm::ArrayRef<uint32_t> operands);
+        bool getTemporary(unsigned position, uint16_t &reg);
+        uint32_t pushValue(uint16_t reg);
+
+        bool visitVariableDecl(VariableDeclAST *vdecl, llvm::ArrayRef<uint32_t> operands, uint32_t &value);
+        bool visitBinaryExpr(BinaryExprAST *bin_expr, llvm::ArrayRef<uint32_t> operands, uint32_t &value);
+        bool visitNullExpr(NullExprAST *null_expr, llvm::ArrayRef<uint32_t> operands, uint32_t &value);
+        bool visitCallExpr(CallExprAST *call_expr, llvm::ArrayRef<uint32_t> operands, uint32_t &value);
+        bool visitJumpStmt(JumpStmtAST *jump_stmt, llvm::ArrayRef<uint32_t> operands, uint32_t &value);
+        bool visitVariable(VariableAST *var, llvm::ArrayRef<uint32_t> operands, uint32_t &value);
+        bool visitNumber(NumberAST *num, llvm::ArrayRef<uint32_t> operands, uint32_t &value);
+};
+
+
+/**
+ * Lower function definition
+ * @param FunctionAST, BytecodeFunction whose registers and code are set
+ * @return success: true fail: false
+ */
+bool BytecodeBuilder::addFunction(FunctionAST *func_ast, BytecodeFunction &func){
+    FunctionStmtAST *body = func_ast->getBody();
+    CurName = func_ast->getName();
+
+    //Declarations, beginning with the parameters
+    NumSlots = 0;
+    for (int i=0; body->getVariableDecl(i); i++)
+        SlotOf[body->getVariableDecl(i)->getName()] = NumSlots++;
+    NumRegisters = NumSlots;
+
+    //Statements
+    func.CodeBegin = Interp->getCodeSize();
+    bool success = NumSlots <= MaxRegisters;
+    uint32_t value;
+    for (int i=0; success && body->getStatement(i); i++){
+        ValueRegs.clear();
+        Live.clear();
+        success = walk(body->getStatement(i), value);
+    }
+    func.NumRegisters = NumRegisters;
+
+    for (int i=0; body->getVariableDecl(i); i++)
+        SlotOf[body->getVariableDecl(i)->getName()] = -1;
+
+    if (!success && NumRegisters >= MaxRegisters)
+        fprintf(stderr, "error: %s needs more than %u registers\n",
+                Symbols->getString(CurName).str().c_str(), MaxRegisters);
+    return success;
+}
+
+/**
+ * Consume the operands of a node
+ * @return position of the result of the node in Live
+ */
+unsigned BytecodeBuilder::popOperands(llvm::ArrayRef<uint32_t> operands){
+    Live.resize(Live.size() - operands.size());
+    return Live.size();
+}
+
+/**
+ * Temporary of the value at position of Live
+ * @return success: true fail: false (too many registers)
+ */
+bool BytecodeBuilder::getTemporary(unsigned position, uint16_t &reg){
+    unsigned index = NumSlots + position;
+    if (index >= MaxRegisters){
+        NumRegisters = MaxRegisters;
+        return false;
+    }
+    NumRegisters = std::max(NumRegisters, index + 1);
+    reg = index;
+    return true;
+}
+
+/**
+ * New value held by reg
+ * @return value number
+ */
+uint32_t BytecodeBuilder::pushValue(uint16_t reg){
+    ValueRegs.push_back(reg);
+    Live.push_back(ValueRegs.size() - 1);
+    return ValueRegs.size() - 1;
+}
+
+/**
+ * Methods emitting the instructions of an AST node, whose operands are
+ * already emitted
+ * @return success: true fail: false
+ */
+bool BytecodeBuilder::visitVariableDecl(VariableDeclAST*, llvm::ArrayRef<uint32_t>, uint32_t&){
+    //Declarations are slots, not instructions
+    return false;
+}
+
+bool BytecodeBuilder::visitBinaryExpr(BinaryExprAST *bin_expr, llvm::ArrayRef<uint32_t> operands, uint32_t &value){
+    unsigned position = popOperands(operands);
+    llvm::StringRef op = bin_expr->getOp();
+    if (op == "="){
+        VariableAST *var = llvm::dyn_cast<VariableAST>(bin_expr->getLHS());
+        if (!var || SlotOf[var->getName()] < 0)
+            return false;
+        uint16_t slot = SlotOf[var->getName()];
+
+        //Reads of the slot still live keep the value before the assignment
+        for (int i=0; i<Live.size(); i++){
+            if (ValueRegs[Live[i]] != slot)
+                continue;
+            uint16_t temp;
+            if (!getTemporary(i, temp))
+                return false;
+            Interp->addInstruction(BC_MOVE, temp, slot, 0);
+            ValueRegs[Live[i]] = temp;
+        }
+
+        uint16_t rhs = ValueRegs[operands[0]];
+        if (rhs != slot)
+            Interp->addInstruction(BC_MOVE, slot, rhs, 0);
+        value = pushValue(rhs);
+        return true;
+    }
+
+    BytecodeOpcode bc_op;
+    switch (op[0]){
+        case '+': bc_op = BC_ADD; break;
+        case '-': bc_op = BC_SUB; break;
+        case '*': bc_op = BC_MUL; break;
+        case '/': bc_op = BC_DIV; break;
+        default: return false;
+    }
+    uint16_t dest;
+    if (!getTemporary(position, dest))
+        return false;
+    Interp->addInstruction(bc_op, dest, ValueRegs[operands[0]], ValueRegs[operands[1]]);
+    value = pushValue(dest);
+    return true;
+}
+
+bool BytecodeBuilder::visitNullExpr(NullExprAST*, llvm::ArrayRef<uint32_t>, uint32_t &value){
+    //Emits nothing
+    value = pushValue(0);
+    return true;
+}
+
+bool BytecodeBuilder::visitCallExpr(CallExprAST *call_expr, llvm::ArrayRef<uint32_t> operands, uint32_t &value){
+    unsigned position = popOperands(operands);
+    ArgRegs.clear();
+    for (int i=0; i<operands.size(); i++)
+        ArgRegs.push_back(ValueRegs[operands[i]]);
+
+    uint16_t dest;
+    if (!getTemporary(position, dest))
+        return false;
+    int callee = Interp->getFunctionIndex(call_expr->getCallee());
+    if (callee >= 0){
+        Interp->addImmInstruction(BC_CALL, dest, Interp->addCallOperands(callee, ArgRegs));
+    }else if ((callee = Interp->getBuiltinIndex(call_expr->getCallee())) >= 0){
+        Interp->addImmInstruction(BC_BUILTIN, dest, Interp->addCallOperands(callee, ArgRegs));
+    }else{
+        fprintf(stderr, "error: %s is called but not defined\n",
+                Symbols->getString(call_expr->getCallee()).str().c_str());
+        return false;
+    }
+    value = pushValue(dest);
+    return true;
+}
+
+bool BytecodeBuilder::visitJumpStmt(JumpStmtAST*, llvm::ArrayRef<uint32_t> operands, uint32_t &value){
+    popOperands(operands);
+    Interp->addInstruction(BC_RETURN, ValueRegs[operands[0]], 0, 0);
+    value = pushValue(0);
+    return true;
+}
+
+bool BytecodeBuilder::visitVariable(VariableAST *var, llvm::ArrayRef<uint32_t>, uint32_t &value){
+    int slot = SlotOf[var->getName()];
+    if (slot < 0)
+        return false;
+    value = pushValue(slot);
+    return true;
+}
+
+bool BytecodeBuilder::visitNumber(NumberAST *num, llvm::ArrayRef<uint32_t> operands, uint32_t &value){
+    uint16_t dest;
+    if (!getTemporary(popOperands(operands), dest))
+        return false;
+    Interp->addImmInstruction(BC_CONST, dest, (uint32_t)num->getNumberValue());
+    value = pushValue(dest);
+    return true;
+}
+
+
+/**
+ * Constructor
+ */
+Interpreter::Interpreter(): TierUp(NULL), TierUpThreshold(DefaultTierUpThreshold), MainFunction(-1){
+    addBuiltin(SYM_PRINTNUM, builtinPrintnum);
+}
+
+/**
+ * Add or replace a builtin
+ * @return success: true fail: false
+ */
+bool Interpreter::addBuiltin(SymbolID name, BuiltinFunction func){
+    if (name >= BuiltinOf.size())
+        BuiltinOf.resize(name + 1, -1);
+    if (BuiltinOf[name] >= 0){
+        Builtins[BuiltinOf[name]] = func;
+    }else{
+        BuiltinOf[name] = Builtins.size();
+        Builtins.push_back(func);
+    }
+    return true;
+}
+
+/**
+ * Count the calls of each function and hand those reaching threshold to
+ * handler (NULL: no counting)
+ * @return success: true fail: false
+ */
+bool Interpreter::setTierUp(TierUpHandler *handler, unsigned threshold){
+    if (threshold < 1)
+        return false;
+    TierUp = handler;
+    TierUpThreshold = threshold;
+    return true;
+}
+
+/**
+ * Install the native code of func; may be called from any thread
+ * @return success: true fail: false
+ */
+bool Interpreter::setNative(int func, NativeFunction code){
+    if (func < 0 || func >= Functions.size())
+        return false;
+    Native[func].store(code, std::memory_order_release);
+    return true;
+}
+
+/**
+ * Functions called by func, each once
+ * @return success: true fail: false
+ */
+bool Interpreter::getCallees(int func, std::vector<int> &callees){
+    if (func < 0 || func >= Functions.size())
+        return false;
+    unsigned end = func + 1 < Functions.size() ? Functions[func + 1].CodeBegin : Code.size();
+    callees.clear();
+    for (unsigned i=Functions[func].CodeBegin; i<end; i++){
+        if (Code[i].Op != BC_CALL)
+            continue;
+        int callee = CallOperands[Code[i].getImm()];
+        if (std::find(callees.begin(), callees.end(), callee) == callees.end())
+            callees.push_back(callee);
+    }
+    return true;
+}
+
+/**
+ * Add the operands of BC_CALL or BC_BUILTIN
+ * @return offset of the operands
+ */
+uint32_t Interpreter::addCallOperands(uint32_t callee, const std::vector<uint16_t> &args){
+    uint32_t offset = CallOperands.size();
+    CallOperands.push_back(callee);
+    CallOperands.push_back(args.size());
+    CallOperands.insert(CallOperands.end(), args.begin(), args.end());
+    return offset;
+}
+
+/**
+ * Lower the functions of tunit to bytecode
+ * Functions are indexed in the order of the TranslationUnitAST
+ * @param TranslationUnitAST
+ * @return success: true fail: false
+ */
+bool Interpreter::load(TranslationUnitAST &tunit){
+    StringInterner *symbols = tunit.getSymbols();
+    Code.clear();
+    CallOperands.clear();
+    Functions.clear();
+    FunctionOf.assign(symbols->size(), -1);
+    MainFunction = -1;
+
+    //Indices first, as a function may call one defined after it
+    for (int i=0; tunit.getFunction(i); i++){
+        FunctionAST *func_ast = tunit.getFunction(i);
+        BytecodeFunction func = {func_ast->getName(),
+            (unsigned)func_ast->getPrototype()->getParamNum(), 0, 0};
+        FunctionOf[func.Name] = Functions.size();
+        if (symbols->getString(func.Name) == "main")
+            MainFunction = Functions.size();
+        Functions.push_back(func);
+    }
+
+    BytecodeBuilder builder(this, symbols);
+    for (int i=0; tunit.getFunction(i); i++){
+        if (!builder.addFunction(tunit.getFunction(i), Functions[i]))
+            return false;
+    }
+
+    Native.reset(new std::atomic<NativeFunction>[Functions.size()]);
+    for (int i=0; i<Functions.size(); i++)
+        Native[i].store(NULL, std::memory_order_relaxed);
+    CallCounts.assign(Functions.size(), 0);
+    return true;
+}
+
+/**
+ * Run main
+ * Each handler ends with the dispatch of the next instruction, so the
+ * indirect branches predict per opcode
+ * @return success: true (returned value in result) fail: false
+ */
+bool Interpreter::run(int &result){
+    if (MainFunction < 0){
+        fprintf(stderr, "error: main is not defined\n");
+        return false;
+    }
+    const BytecodeFunction &main_func = Functions[MainFunction];
+    Frames.clear();
+    if (Registers.size() < main_func.NumRegisters)
+        Registers.resize(main_func.NumRegisters);
+    std::fill(Registers.begin(), Registers.begin() + main_func.NumRegisters, 0);
+
+    size_t base = 0;
+    unsigned num_registers = main_func.NumRegisters;
+    int *regs = Registers.data();
+    const Instruction *pc = &Code[main_func.CodeBegin];
+
+#if defined(__GNUC__)
+    //Handlers indexed by BytecodeOpcode
+    static void *const handlers[NUM_BYTECODE_OPCODES] = {
+        &&op_BC_CONST, &&op_BC_MOVE, &&op_BC_ADD, &&op_BC_SUB, &&op_BC_MUL,
+        &&op_BC_DIV, &&op_BC_CALL, &&op_BC_BUILTIN, &&op_BC_RETURN
+    };
+#define DISPATCH() goto *handlers[pc->Op]
+#define OPCODE(op) op_##op
+#else
+#define DISPATCH() goto dispatch
+#define OPCODE(op) case op
+#endif
+
+    DISPATCH();
+#if !defined(__GNUC__)
+dispatch:
+    switch (pc->Op){
+#endif
+    OPCODE(BC_CONST):
+        regs[pc->A] = (int)pc->getImm();
+        pc++;
+        DISPATCH();
+
+    OPCODE(BC_MOVE):
+        regs[pc->A] = regs[pc->B];
+        pc++;
+        DISPATCH();
+
+    //+ - * wrap at 32 bits as the instructions of CodeGen
+    OPCODE(BC_ADD):
+        regs[pc->A] = (int)((uint32_t)regs[pc->B] + (uint32_t)regs[pc->C]);
+        pc++;
+        DISPATCH();
+
+    OPCODE(BC_SUB):
+        regs[pc->A] = (int)((uint32_t)regs[pc->B] - (uint32_t)regs[pc->C]);
+        pc++;
+        DISPATCH();
+
+    OPCODE(BC_MUL):
+        regs[pc->A] = (int)((uint32_t)regs[pc->B] * (uint32_t)regs[pc->C]);
+        pc++;
+        DISPATCH();
+
+    OPCODE(BC_DIV):{
+        int lhs = regs[pc->B], rhs = regs[pc->C];
+        if (rhs == 0 || (lhs == INT32_MIN && rhs == -1)){
+            fprintf(stderr, "error: %s\n", rhs == 0 ? "division by zero" : "division overflow");
+            return false;
+        }
+        regs[pc->A] = lhs / rhs;
+        pc++;
+        DISPATCH();
+    }
+
+    OPCODE(BC_CALL):{
+        const uint32_t *operands = &CallOperands[pc->getImm()];
+        unsigned num_args = operands[1];
+        if (TierUp){
+            NativeFunction native = Native[operands[0]].load(std::memory_order_acquire);
+            if (native){
+                Arguments.resize(num_args);
+                for (unsigned i=0; i<num_args; i++)
+                    Arguments[i] = regs[operands[2 + i]];
+                regs[pc->A] = native(Arguments.data());
+                pc++;
+                DISPATCH();
+            }
+            if (++CallCounts[operands[0]] == TierUpThreshold)
+                TierUp->requestTierUp(operands[0]);
+        }
+
+        const BytecodeFunction &callee = Functions[operands[0]];
+        size_t callee_base = base + num_registers;
+        size_t stack_size = callee_base + callee.NumRegisters;
+        if (Frames.size() >= MaxCallDepth){
+            fprintf(stderr, "error: calls nested deeper than %u\n", MaxCallDepth);
+            return false;
+        }
+        if (stack_size > MaxStackRegisters){
+            fprintf(stderr, "error: calls need more than %zu registers\n", MaxStackRegisters);
+            return false;
+        }
+        if (stack_size > Registers.size()){
+            Registers.resize(std::max(Registers.size() * 2, stack_size));
+            regs = Registers.data() + base;
+        }
+
+        //Arguments to the parameters, the other registers start at 0
+        int *callee_regs = Registers.data() + callee_base;
+        for (unsigned i=0; i<num_args; i++)
+            callee_regs[i] = regs[operands[2 + i]];
+        std::fill(callee_regs + num_args, callee_regs + callee.NumRegisters, 0);
+
+        CallFrame frame = {pc + 1, base, num_registers, pc->A};
+        Frames.push_back(frame);
+        base = callee_base;
+        num_registers = callee.NumRegisters;
+        regs = callee_regs;
+        pc = &Code[callee.CodeBegin];
+        DISPATCH();
+    }
+
+    OPCODE(BC_BUILTIN):{
+        const uint32_t *operands = &CallOperands[pc->getImm()];
+        unsigned num_args = operands[1];
+        Arguments.resize(num_args);
+        for (unsigned i=0; i<num_args; i++)
+            Arguments[i] = regs[operands[2 + i]];
+        regs[pc->A] = Builtins[operands[0]](Arguments.data(), num_args);
+        pc++;
+        DISPATCH();
+    }
+
+    OPCODE(BC_RETURN):{
+        int value = regs[pc->A];
+        if (Frames.empty()){
+            result = value;
+            return true;
+        }
+        const CallFrame &frame = Frames.back();
+        base = frame.Base;
+        num_registers = frame.NumRegisters;
+        regs = Registers.data() + base;
+        regs[frame.ResultRegister] = value;
+        pc = frame.ReturnPC;
+        Frames.pop_back();
+        DISPATCH();
+    }
+#if !defined(__GNUC__)
+    }
+#endif
+#undef DISPATCH
+#undef OPCODE
+
+    //Unknown opcode
+    return false;
+}
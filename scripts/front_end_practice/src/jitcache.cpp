@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include <unistd.h>
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "jitcache.hpp"
+
+
+/**
+ * Object file of the cache
+ */
+typedef struct CachedObject{
+    std::string Path;
+    llvm::sys::TimeValue LastUse;
+    uint64_t Bytes;
+}CachedObject;
+
+static bool lessRecentlyUsed(const CachedObject &lhs, const CachedObject &rhs){
+    return lhs.LastUse < rhs.LastUse;
+}
+
+
+/**
+ * Constructor
+ * @param cache directory (created if missing), size limit of the objects
+ */
+JITObjectCache::JITObjectCache(const std::string &directory, uint64_t max_bytes)
+    : Directory(directory), MaxBytes(max_bytes), Hits(0), Misses(0), Evictions(0){
+    llvm::sys::fs::create_directories(Directory);
+}
+
+/**
+ * Destructor
+ */
+JITObjectCache::~JITObjectCache(){
+    updateStats();
+}
+
+/**
+ * Take the key of mod before MCJIT compiles it
+ * @param Module, description of the target the object is built for
+ * @return success: true fail: false
+ */
+bool JITObjectCache::addModule(const llvm::Module *mod, llvm::StringRef target){
+    std::string text;
+    llvm::raw_string_ostream stream(text);
+    mod->print(stream, NULL);
+    stream.flush();
+
+    llvm::MD5 hash;
+    hash.update(text);
+    hash.update(llvm::StringRef("\0", 1));
+    hash.update(target);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> key;
+    llvm::MD5::stringifyResult(result, key);
+    Keys[mod] = key.str();
+    return true;
+}
+
+/**
+ * Called by MCJIT after compiling mod: store its object
+ */
+void JITObjectCache::notifyObjectCompiled(const llvm::Module *mod, const llvm::MemoryBuffer *obj){
+    llvm::DenseMap<const llvm::Module*, std::string>::iterator key = Keys.find(mod);
+    if (key == Keys.end())
+        return;
+
+    //Written under a unique name and renamed, so readers see whole files
+    int fd;
+    llvm::SmallString<128> temp_path;
+    if (llvm::sys::fs::createUniqueFile(Directory + "/tmp-%%%%%%%%.o", fd, temp_path))
+        return;
+    llvm::raw_fd_ostream stream(fd, true);
+    stream.write(obj->getBufferStart(), obj->getBufferSize());
+    stream.close();
+    if (stream.has_error() || llvm::sys::fs::rename(temp_path.str(), getObjectPath(key->second))){
+        stream.clear_error();
+        llvm::sys::fs::remove(temp_path.str());
+        return;
+    }
+    evict();
+}
+
+/**
+ * Called by MCJIT before compiling mod
+ * @return hit: object owned by the caller miss: NULL
+ */
+llvm::MemoryBuffer *JITObjectCache::getObject(const llvm::Module *mod){
+    llvm::DenseMap<const llvm::Module*, std::string>::iterator key = Keys.find(mod);
+    if (key == Keys.end())
+        return NULL;
+
+    std::string path = getObjectPath(key->second);
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer> > buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer){
+        Misses++;
+        return NULL;
+    }
+    Hits++;
+
+    //The modification time orders the objects for eviction
+    int fd;
+    if (!llvm::sys::fs::openFileForRead(path, fd)){
+        llvm::sys::fs::setLastModificationAndAccessTime(fd, llvm::sys::TimeValue::now());
+        close(fd);
+    }
+    return buffer.get().release();
+}
+
+/**
+ * Path of the object of key
+ */
+std::string JITObjectCache::getObjectPath(const std::string &key){
+    return Directory + "/" + key + ".o";
+}
+
+/**
+ * Remove the least recently used objects until they fit in MaxBytes
+ * @return success: true fail: false
+ */
+bool JITObjectCache::evict(){
+    std::vector<CachedObject> objects;
+    uint64_t total = 0;
+    std::error_code ec;
+    for (llvm::sys::fs::directory_iterator it(Directory, ec), end; it != end && !ec; it.increment(ec)){
+        if (llvm::sys::path::extension(it->path()) != ".o" ||
+                llvm::sys::path::filename(it->path()).startswith("tmp-"))
+            continue;
+        llvm::sys::fs::file_status status;
+        if (llvm::sys::fs::status(it->path(), status))
+            continue;
+        CachedObject object = {it->path(), status.getLastModificationTime(), status.getSize()};
+        objects.push_back(object);
+        total += object.Bytes;
+    }
+    if (ec)
+        return false;
+
+    std::sort(objects.begin(), objects.end(), lessRecentlyUsed);
+    for (int i=0; i<objects.size() && total > MaxBytes; i++){
+        if (llvm::sys::fs::remove(objects[i].Path))
+            continue;
+        total -= objects[i].Bytes;
+        Evictions++;
+    }
+    return true;
+}
+
+/**
+ * Add the counts of this run to the file "stats"
+ * @return success: true fail: false
+ */
+bool JITObjectCache::updateStats(){
+    std::string path = Directory + "/stats";
+    long hits = 0, misses = 0, evictions = 0;
+    FILE *fp = fopen(path.c_str(), "r");
+    if (fp){
+        if (fscanf(fp, "hits %ld\nmisses %ld\nevictions %ld\n", &hits, &misses, &evictions) != 3)
+            hits = misses = evictions = 0;
+        fclose(fp);
+    }
+
+    fp = fopen(path.c_str(), "w");
+    if (!fp)
+        return false;
+    fprintf(fp, "hits %ld\nmisses %ld\nevictions %ld\n",
+            hits + Hits, misses + Misses, evictions + Evictions);
+    fclose(fp);
+    return true;
+}
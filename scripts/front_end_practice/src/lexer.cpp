@@ -1,12 +1,38 @@
 #include "lexer.hpp"
+#include "scan.hpp"
+#include <stdint.h>
+
+/**
+ * 数字列の値
+ * 符号なしで積算するので、2^31以上のリテラルもオーバーフローせず2^32を法として丸められる
+ */
+static int digitValue(llvm::StringRef string){
+    uint32_t value = 0;
+    for (int i=0; i<string.size(); i++)
+        value = value * 10 + (string[i] - '0');
+    return (int)value;
+}
+
+/**
+ * 識別子のシンボルからトークン種別を決める(予約語判定)
+ */
+static TokenType identifierType(SymbolID symbol){
+    if (symbol == SYM_INT){
+        return TOK_INT;
+    }else if (symbol == SYM_RETURN){
+        return TOK_RETURN;
+    }else{
+        return TOK_IDENTIFIER;
+    }
+}
 
 /**
  * トークン切り出し関数
- * @param 字句解析対象ファイル名
+ * @param 字句解析対象ファイル名 識別子を登録するテーブル
  * @return 切り出したトークンを格納したTokenStream
  */
-TokenStream *LexicalAnalysis(std::string input_filename){
-    TokenStream *tokens = new TokenStream();
+TokenStream *LexicalAnalysis(std::string input_filename, StringInterner *symbols){
+    TokenStream *tokens = new TokenStream(symbols);
     std::ifstream ifs;
     std::string cur_line;
     std::string token_str;
@@ -19,7 +45,8 @@ TokenStream *LexicalAnalysis(std::string input_filename){
     while (ifs && getline(ifs, cur_line)){
         char next_char;
         std::string line;
-        Token *next_token;
+        TokenType next_type;
+        int next_value;
         int index = 0;
         int length = cur_line.length();
 
@@ -40,7 +67,8 @@ TokenStream *LexicalAnalysis(std::string input_filename){
             //EOF
             if (next_char == EOF){
                 token_str = EOF;
-                next_token = new Token(token_str, TOK_EOF, line_num);
+                next_type = TOK_EOF;
+                next_value = 0;
             }else if (isspace(next_char)){
                 continue;
             //IDENTIFIER
@@ -55,19 +83,15 @@ TokenStream *LexicalAnalysis(std::string input_filename){
                 }
                 index--;
 
-                if (token_str == "int"){
-                    next_token = new Token(token_str, TOK_INT, line_num);    
-                }else if (token_str == "return"){
-                    next_token = new Token(token_str, TOK_RETURN, line_num);
-                }else{
-                    next_token = new Token(token_str, TOK_IDENTIFIER, line_num);
-                }
+                next_value = symbols->intern(token_str);
+                next_type = identifierType(next_value);
 
             //Number
             }else if (isdigit(next_char)){
                 if (next_char == '0'){
                     token_str += next_char;
-                    next_token = new Token(token_str, TOK_DIGIT, line_num);
+                    next_type = TOK_DIGIT;
+                    next_value = 0;
                 }else{
                     token_str += next_char;
                     next_char = cur_line.at(index++);
@@ -75,7 +99,8 @@ TokenStream *LexicalAnalysis(std::string input_filename){
                         token_str += next_char;
                         next_char = cur_line.at(index++);
                     }
-                    next_token = new Token(token_str, TOK_DIGIT, line_num);
+                    next_type = TOK_DIGIT;
+                    next_value = digitValue(token_str);
                     index--;
                 }
 
@@ -96,7 +121,8 @@ TokenStream *LexicalAnalysis(std::string input_filename){
                 //DIVIDER('/')
                 }else{
                     index--;
-                    next_token = new Token(token_str, TOK_SYMBOL, line_num);
+                    next_type = TOK_SYMBOL;
+                    next_value = 0;
                 }
             }else{
                 if (next_char == '*' ||
@@ -110,18 +136,19 @@ TokenStream *LexicalAnalysis(std::string input_filename){
                         next_char == '{' ||
                         next_char == '}'){
                     token_str += next_char;
-                    next_token = new Token(token_str, TOK_SYMBOL, line_num);
+                    next_type = TOK_SYMBOL;
+                    next_value = 0;
 
                 //解析不能字句
                 }else{
-                    fprint(stdout, "unclear token : %c", next_char);
+                    fprintf(stdout, "unclear token : %c", next_char);
                     SAFE_DELETE(tokens);
                     return NULL;
                 }
             }
 
             //Add to Tokens
-            tokens->pushToken(next_token);
+            tokens->pushToken(next_type, token_str, line_num, next_value);
             token_str.clear();
         }
 
@@ -131,9 +158,7 @@ TokenStream *LexicalAnalysis(std::string input_filename){
 
     //Confirm EOF
     if (ifs.eof()){
-        tokens->pushToken(
-                new Token(token_str, TOK_EOF, line_num)
-                );
+        tokens->pushToken(TOK_EOF, token_str, line_num, 0);
     }
 
     //Close
@@ -143,14 +168,366 @@ TokenStream *LexicalAnalysis(std::string input_filename){
 
 
 
+/**
+ * この長さまでの識別子・数字列は直接判定し、それより長い部分をScannerに任せる
+ */
+static const int ShortRun = 8;
+
+/**
+ * バッファ[cur, end)からトークンを切り出してtokensへ追加する
+ * at_eofでない場合、バッファ末尾に掛かるトークンは解析せず次回へ持ち越す
+ * コメント中かどうかと行番号はstateで引き継ぐ
+ * @param 解析開始位置 バッファ終端 入力終端か否か 字句解析状態 追加先
+ * @return 成功時:解析を終えた位置 失敗時:NULL
+ */
+static const char *scanBuffer(const char *cur, const char *end, bool at_eof,
+        LexState &state, TokenStream *tokens){
+    const Scanner &scan = getScanner();
+
+    while (cur < end){
+        //Comment body ('//')
+        if (state.InLineComment){
+            cur = (const char*)memchr(cur, '\n', end - cur);
+            if (!cur)
+                return end;
+            state.InLineComment = false;
+        }
+
+        //Comment body ('/* */')
+        if (state.InBlockComment){
+            cur = scan.findCommentEnd(cur, end, state.Line);
+            if (cur == end){
+                //"*/" may be split by the end of the buffer
+                return (!at_eof && end[-1] == '*') ? end - 1 : end;
+            }
+            cur += 2;
+            state.InBlockComment = false;
+            continue;
+        }
+
+        unsigned char next_char = *cur;
+        const char *token_start = cur;
+        TokenType type;
+        int value = 0;
+
+        //White space and new line
+        //Single characters are handled here, longer runs by the scanner
+        if (isSpaceChar(next_char)){
+            if (next_char == '\n')
+                state.Line++;
+            if (++cur < end && isSpaceChar(*cur))
+                cur = scan.skipSpace(cur, end, state.Line);
+            continue;
+
+        //IDENTIFIER
+        }else if (isAlphaChar(next_char)){
+            while (++cur < end && isAlnumChar(*cur) && cur - token_start < ShortRun)
+                ;
+            if (cur < end && isAlnumChar(*cur))
+                cur = scan.skipAlnum(cur, end);
+            if (cur == end && !at_eof)
+                return token_start;
+
+            value = tokens->getSymbols()->intern(
+                    llvm::StringRef(token_start, cur - token_start));
+            type = identifierType(value);
+
+        //Number
+        }else if (isDigitChar(next_char)){
+            if (next_char == '0'){
+                cur++;
+            }else{
+                while (++cur < end && isDigitChar(*cur) && cur - token_start < ShortRun)
+                    ;
+                if (cur < end && isDigitChar(*cur))
+                    cur = scan.skipDigit(cur, end);
+                if (cur == end && !at_eof)
+                    return token_start;
+            }
+            type = TOK_DIGIT;
+            value = digitValue(llvm::StringRef(token_start, cur - token_start));
+
+        //Comment or '/'
+        }else if (next_char == '/'){
+            if (cur + 1 == end && !at_eof)
+                return token_start;
+            cur++;
+
+            //Comment
+            if (cur < end && *cur == '/'){
+                cur++;
+                state.InLineComment = true;
+                continue;
+
+            //Comment
+            }else if (cur < end && *cur == '*'){
+                cur++;
+                state.InBlockComment = true;
+                continue;
+
+            //DIVIDER('/')
+            }else{
+                type = TOK_SYMBOL;
+            }
+        }else if (next_char == '*' ||
+                next_char == '+' ||
+                next_char == '-' ||
+                next_char == '=' ||
+                next_char == ';' ||
+                next_char == ',' ||
+                next_char == '(' ||
+                next_char == ')' ||
+                next_char == '{' ||
+                next_char == '}'){
+            cur++;
+            type = TOK_SYMBOL;
+
+        //解析不能字句
+        }else{
+            fprintf(stdout, "unclear token : %c", next_char);
+            return NULL;
+        }
+
+        //Add to Tokens
+        tokens->pushToken(type,
+                llvm::StringRef(token_start, cur - token_start), state.Line, value);
+    }
+    return cur;
+}
+
+
+/**
+ * メモリマップしたファイルからトークンを切り出す
+ * トークンはバッファ内の(offset, length)を参照し、文字列を確保しない
+ * @param 字句解析対象ファイル名
+ * @return 切り出したトークンとマップしたバッファを格納したTokenStream
+ */
+TokenStream *LexicalAnalysisMapped(std::string input_filename, StringInterner *symbols){
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer> > buffer =
+        llvm::MemoryBuffer::getFile(input_filename);
+    if (!buffer)
+        return NULL;
+
+    //Offsets are 32bit
+    if (buffer.get()->getBufferSize() > 0xffffffffULL){
+        fprintf(stderr, "%s is too large to map, use streaming mode\n",
+                input_filename.c_str());
+        return NULL;
+    }
+
+    return LexicalAnalysisBuffer(buffer.get().release(), symbols);
+}
+
+
+/**
+ * メモリ上のバッファからトークンを切り出す
+ * @param 字句解析対象バッファ(TokenStreamが所有する)
+ * @return 切り出したトークンとバッファを格納したTokenStream
+ */
+TokenStream *LexicalAnalysisBuffer(llvm::MemoryBuffer *buffer, StringInterner *symbols){
+    TokenStream *tokens = new TokenStream(symbols);
+    tokens->setSource(buffer);
+    tokens->reserve(tokens->getSource()->getBufferSize() / 4);
+
+    const char *source = tokens->getSource()->getBufferStart();
+    const char *end = tokens->getSource()->getBufferEnd();
+    LexState state = {0, false, false};
+
+    if (!scanBuffer(source, end, true, state, tokens)){
+        SAFE_DELETE(tokens);
+        return NULL;
+    }
+
+    //EOF
+    tokens->pushToken(TOK_EOF, llvm::StringRef(end, 0), state.Line, 0);
+    return tokens;
+}
+
+
+/**
+ * 入力を固定長バッファで読みながら、必要になった時点でトークンを切り出す
+ * TokenStreamはreleaseTokens()で解放されるまでのトークンのみ保持する
+ * @param 字句解析対象ファイル名
+ * @return 最初のトークンを切り出し済みのTokenStream
+ */
+TokenStream *LexicalAnalysisStream(std::string input_filename, StringInterner *symbols){
+    FILE *input = fopen(input_filename.c_str(), "rb");
+    if (!input)
+        return NULL;
+
+    TokenStream *tokens = new TokenStream(symbols);
+    tokens->setInput(input);
+    if (!tokens->fill() || tokens->hasError()){
+        SAFE_DELETE(tokens);
+        return NULL;
+    }
+    return tokens;
+}
+
+
+
 /**
  * デストラクタ
  */
 TokenStream::~TokenStream(){
-    for(int i=0; i<Tokens.size(); i++){
-        SAFE_DELETE(Tokens[i]);
+    SAFE_DELETE(Source);
+    if (Input)
+        fclose(Input);
+}
+
+/**
+ * ストリーム入力を設定する
+ */
+bool TokenStream::setInput(FILE *input){
+    Input = input;
+    Streaming = true;
+    Buffer.resize(StreamBufferSize);
+    BufferPos = BufferLen = 0;
+    return true;
+}
+
+/**
+ * 入力からBufferを補充し、トークンが1つ以上増えるまで字句解析する
+ * 入力終端に達したらTOK_EOFを追加する
+ * @return トークンを追加した場合:true 入力が無い場合:false
+ */
+bool TokenStream::fill(){
+    int num = Arrays->Types.size();
+    while (Input && Arrays->Types.size() == num){
+        //Move the unfinished token to the head of the buffer
+        int rest = BufferLen - BufferPos;
+        if (rest == Buffer.size()){
+            fprintf(stderr, "token is longer than %d bytes\n", (int)Buffer.size());
+            HasError = true;
+        }else{
+            memmove(&Buffer[0], &Buffer[BufferPos], rest);
+            BufferLen = rest + fread(&Buffer[rest], 1, Buffer.size() - rest, Input);
+            BufferPos = 0;
+            if (ferror(Input))
+                HasError = true;
+        }
+
+        bool at_eof = HasError || feof(Input);
+        if (!HasError){
+            const char *begin = &Buffer[0];
+            const char *stop = scanBuffer(begin, begin + BufferLen, at_eof, State, this);
+            if (stop)
+                BufferPos = stop - begin;
+            else
+                HasError = true;
+        }
+
+        //EOF
+        if (at_eof || HasError){
+            pushToken(TOK_EOF, llvm::StringRef(), State.Line, 0);
+            fclose(Input);
+            Input = NULL;
+        }
     }
-    Tokens.clear();
+    return Arrays->Types.size() != num;
+}
+
+/**
+ * index番目より前のトークンへ戻ることはもう無いと通知する
+ * ストリームモードでは、不要になった分が保持数の半分を超えた時点で配列を詰める
+ * @return 成功時:true 失敗時:false
+ */
+bool TokenStream::releaseTokens(int index){
+    if (index < Base || index > CurIndex)
+        return false;
+
+    int dead = index - Base;
+    if (!Streaming || dead < ReleaseThreshold || dead * 2 < Arrays->Types.size())
+        return true;
+
+    //Drop token text
+    unsigned text_start = Arrays->Offsets[dead];
+    Text.erase(0, text_start);
+    for (int i=dead; i<Arrays->Offsets.size(); i++)
+        Arrays->Offsets[i] -= text_start;
+
+    Arrays->Types.erase(Arrays->Types.begin(), Arrays->Types.begin() + dead);
+    Arrays->Offsets.erase(Arrays->Offsets.begin(), Arrays->Offsets.begin() + dead);
+    Arrays->Lengths.erase(Arrays->Lengths.begin(), Arrays->Lengths.begin() + dead);
+    Arrays->Lines.erase(Arrays->Lines.begin(), Arrays->Lines.begin() + dead);
+    Arrays->Values.erase(Arrays->Values.begin(), Arrays->Values.begin() + dead);
+    Base = index;
+    return true;
+}
+
+/**
+ * 現在位置から次の1文字の記号symbolまで読み飛ばす
+ * ストリームモードでは必要に応じて字句解析を進める
+ * @return 見つかった場合:true(その記号が現在のトークン) EOFに達した場合:false
+ */
+bool TokenStream::skipToSymbol(char symbol){
+    const char *text = getTextBase();
+    while (true){
+        int size = Arrays->Types.size();
+        for (int i=CurIndex-Base; i<size; i++){
+            if (Arrays->Types[i] == TOK_SYMBOL && Arrays->Lengths[i] == 1 && text[Arrays->Offsets[i]] == symbol){
+                CurIndex = Base + i;
+                return true;
+            }
+            if (Arrays->Types[i] == TOK_EOF){
+                CurIndex = Base + i;
+                return false;
+            }
+        }
+        CurIndex = Base + size - 1;
+        if (!fill())
+            return false;
+        text = getTextBase();
+    }
+}
+
+/**
+ * このストリームのトークン配列を共有し、独立した読み出し位置を持つビューを作る
+ * ビューを使う間、このストリームは破棄も変更もされない事
+ * @return 成功時:TokenStream 失敗時(ストリームモード):NULL
+ */
+TokenStream *TokenStream::createView(){
+    if (Streaming)
+        return NULL;
+
+    TokenStream *view = new TokenStream(Symbols);
+    view->Arrays = Arrays;
+    view->SharedText = getTextBase();
+    view->Base = Base;
+    view->CurIndex = CurIndex;
+    return view;
+}
+
+/**
+ * トークンを末尾に追加する
+ * マップしたバッファ上の文字列はオフセットのみ記録し、それ以外はTextへ複製する
+ * @param トークン種別 トークン文字列 行番号 値(数字の値、識別子のシンボル)
+ * @return true
+ */
+bool TokenStream::pushToken(TokenType type, llvm::StringRef string, int line, int value){
+    if (Source){
+        Arrays->Offsets.push_back(string.data() - Source->getBufferStart());
+    }else{
+        Arrays->Offsets.push_back(Text.size());
+        Text.append(string.data(), string.size());
+    }
+    Arrays->Types.push_back(type);
+    Arrays->Lengths.push_back(string.size());
+    Arrays->Lines.push_back(line);
+    Arrays->Values.push_back(value);
+    return true;
+}
+
+/**
+ * num個のトークン分の領域を予約する
+ */
+bool TokenStream::reserve(int num){
+    Arrays->Types.reserve(num);
+    Arrays->Offsets.reserve(num);
+    Arrays->Lengths.reserve(num);
+    Arrays->Lines.reserve(num);
+    Arrays->Values.reserve(num);
+    return true;
 }
 
 /**
@@ -158,7 +535,20 @@ TokenStream::~TokenStream(){
  * @return CurIndex番目のToken
  */
 Token TokenStream::getToken(){
-    return *Tokens[CurIndex];
+    return Token(getCurType(), getCurRef(), getCurNumVal(), getCurLine());
+}
+
+/**
+ * インデックスを進めずに次のトークンを取得する
+ * 現在のトークンがEOFの場合はEOFを返す
+ */
+Token TokenStream::peekToken(){
+    int next = CurIndex - Base + 1;
+    if (next >= (int)Arrays->Types.size() && !fill())
+        next = CurIndex - Base;
+    return Token((TokenType)Arrays->Types[next],
+            llvm::StringRef(getTextBase() + Arrays->Offsets[next], Arrays->Lengths[next]),
+            Arrays->Values[next], Arrays->Lines[next]);
 }
 
 /**
@@ -166,10 +556,8 @@ Token TokenStream::getToken(){
  * @return 成功時:true 失敗時:false
  */
 bool TokenStream::getNextToken(){
-    int size = Tokens.size();
-    if (--size == CurIndex){
-        return false;
-    }else if(CurIndex < size){
+    int size = Arrays->Types.size();
+    if (CurIndex - Base + 1 < size || fill()){
         CurIndex++;
         return true;
     }else{
@@ -182,7 +570,7 @@ bool TokenStream::getNextToken(){
  */
 bool TokenStream::ungetToken(int times){
     for (int i=0; i<times; i++){
-        if (CurIndex == 0){
+        if (CurIndex == Base){
             return false;
         }else{
             CurIndex--;
@@ -191,16 +579,28 @@ bool TokenStream::ungetToken(int times){
     return true;
 }
 
+/**
+ * トークン格納に使用しているヒープ量(バイト)
+ * マップしたバッファは含まない
+ */
+size_t TokenStream::getMemoryUsage(){
+    return Arrays->Types.capacity() * sizeof(unsigned char) +
+        Arrays->Offsets.capacity() * sizeof(unsigned) +
+        Arrays->Lengths.capacity() * sizeof(unsigned) +
+        Arrays->Lines.capacity() * sizeof(int) +
+        Arrays->Values.capacity() * sizeof(int) +
+        Text.capacity() + Buffer.capacity();
+}
+
 /**
  * 格納されたトークン一覧を表示する
  */
 bool TokenStream::printTokens(){
-    std::vector<Token*>::iterator titer = Tokens.begin();
-    while(titer != Tokens.end()){
-        fprint(stdout, "%d:", (*titer)->getTokenType());
-        if((*titer)->getTokenType() != TOK_EOF)
-            fprint(stdout, "%s\n", (*titer)->getTokenString().c_str());
-        ++titer;
+    const char *text = getTextBase();
+    for (int i=0; i<Arrays->Types.size(); i++){
+        fprintf(stdout, "%d:", Arrays->Types[i]);
+        if(Arrays->Types[i] != TOK_EOF)
+            fprintf(stdout, "%.*s\n", (int)Arrays->Lengths[i], text + Arrays->Offsets[i]);
     }
     return true;
 }
@@ -0,0 +1,159 @@
+#include "llvm/Pass.h"
+#include "llvm/PassManager.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/Scalar.h"
+#include "optimizer.hpp"
+
+
+/**
+ * Pass of the pipelines
+ */
+typedef struct PassEntry{
+    const char *Name;
+    llvm::Pass *(*Create)();
+}PassEntry;
+
+static llvm::Pass *createMem2Reg(){return llvm::createPromoteMemoryToRegisterPass();}
+static llvm::Pass *createEarlyCSE(){return llvm::createEarlyCSEPass();}
+static llvm::Pass *createInstCombine(){return llvm::createInstructionCombiningPass();}
+static llvm::Pass *createReassociate(){return llvm::createReassociatePass();}
+static llvm::Pass *createGVN(){return llvm::createGVNPass();}
+static llvm::Pass *createSCCP(){return llvm::createSCCPPass();}
+static llvm::Pass *createDCE(){return llvm::createDeadCodeEliminationPass();}
+static llvm::Pass *createADCE(){return llvm::createAggressiveDCEPass();}
+static llvm::Pass *createTailCallElim(){return llvm::createTailCallEliminationPass();}
+static llvm::Pass *createSimplifyCFG(){return llvm::createCFGSimplificationPass();}
+static llvm::Pass *createInliner(){return llvm::createFunctionInliningPass();}
+static llvm::Pass *createAggressiveInliner(){return llvm::createFunctionInliningPass(275);}
+static llvm::Pass *createIPSCCP(){return llvm::createIPSCCPPass();}
+static llvm::Pass *createDeadArgElim(){return llvm::createDeadArgEliminationPass();}
+static llvm::Pass *createGlobalDCE(){return llvm::createGlobalDCEPass();}
+
+static const PassEntry PassTable[] = {
+    {"mem2reg", createMem2Reg},
+    {"early-cse", createEarlyCSE},
+    {"instcombine", createInstCombine},
+    {"reassociate", createReassociate},
+    {"gvn", createGVN},
+    {"sccp", createSCCP},
+    {"dce", createDCE},
+    {"adce", createADCE},
+    {"tailcallelim", createTailCallElim},
+    {"simplifycfg", createSimplifyCFG},
+    {"inline", createInliner},
+    {"inline-aggressive", createAggressiveInliner},
+    {"ipsccp", createIPSCCP},
+    {"deadargelim", createDeadArgElim},
+    {"globaldce", createGlobalDCE}
+};
+static const int NumPasses = sizeof(PassTable) / sizeof(PassTable[0]);
+
+/**
+ * Pipelines of -O0 to -O3
+ * Functions have a single basic block, so nothing here works on loops
+ * or branches; simplifycfg is left to -passes=
+ */
+static const char *const LevelPipelines[MaxOptLevel + 1] = {
+    "mem2reg",
+    "mem2reg,early-cse,instcombine,sccp,dce,tailcallelim",
+    "mem2reg,inline,early-cse,instcombine,gvn,sccp,instcombine,tailcallelim,adce,globaldce",
+    "mem2reg,ipsccp,deadargelim,inline-aggressive,early-cse,instcombine,reassociate,gvn,sccp,instcombine,tailcallelim,adce,globaldce"
+};
+
+
+/**
+ * Find a pass by name
+ * @return success: PassEntry fail: NULL
+ */
+static const PassEntry *findPass(llvm::StringRef name){
+    for (int i=0; i<NumPasses; i++){
+        if (name == PassTable[i].Name)
+            return &PassTable[i];
+    }
+    return NULL;
+}
+
+/**
+ * Select the pipeline of -O level
+ * @return success: true fail: false
+ */
+bool Optimizer::setOptLevel(int level){
+    if (level < 0 || level > MaxOptLevel)
+        return false;
+    return setPasses(LevelPipelines[level]);
+}
+
+/**
+ * Select a pipeline given as pass names separated by commas
+ * The current pipeline is kept when a name is unknown
+ * @return success: true fail: false
+ */
+bool Optimizer::setPasses(llvm::StringRef list){
+    std::vector<std::string> passes;
+    while (!list.empty()){
+        std::pair<llvm::StringRef, llvm::StringRef> split = list.split(',');
+        llvm::StringRef name = split.first.trim();
+        list = split.second;
+        if (name.empty())
+            continue;
+        if (!findPass(name)){
+            fprintf(stderr, "%s is unknown pass\n", name.str().c_str());
+            return false;
+        }
+        passes.push_back(name.str());
+    }
+    Passes.swap(passes);
+    return true;
+}
+
+/**
+ * Drop mem2reg when CodeGen builds SSA values directly
+ */
+bool Optimizer::setDirectSSA(bool direct_ssa){
+    if (!direct_ssa)
+        return true;
+    std::vector<std::string> passes;
+    for (int i=0; i<Passes.size(); i++){
+        if (Passes[i] != "mem2reg")
+            passes.push_back(Passes[i]);
+    }
+    Passes.swap(passes);
+    return true;
+}
+
+/**
+ * Get the pipeline as the list -passes= takes
+ */
+std::string Optimizer::getPipeline(){
+    std::string list;
+    for (int i=0; i<Passes.size(); i++){
+        if (i > 0)
+            list += ",";
+        list += Passes[i];
+    }
+    return list;
+}
+
+/**
+ * Run the pipeline on mod
+ * @return success: true fail: false
+ */
+bool Optimizer::run(llvm::Module &mod){
+    if (Passes.empty())
+        return true;
+
+    llvm::PassManager pm;
+    for (int i=0; i<Passes.size(); i++)
+        pm.add(findPass(Passes[i])->Create());
+    pm.run(mod);
+    return true;
+}
+
+/**
+ * Print the names -passes= takes
+ */
+void Optimizer::printPassNames(FILE *out){
+    for (int i=0; i<NumPasses; i++)
+        fprintf(out, "%s%s", i > 0 ? "," : "", PassTable[i].Name);
+    fprintf(out, "\n");
+}
@@ -1,11 +1,74 @@
+#include <atomic>
+#include <thread>
 #include "parser.hpp"
 
 
+/**
+ * Chunks of deferred function bodies shared by the worker threads
+ */
+struct BodyQueue{
+    const std::vector<int> &Chunks; //Index of the first job of each chunk, and the end
+    std::atomic<int> Next;
+    std::atomic<bool> Failed;
+
+    BodyQueue(const std::vector<int> &chunks): Chunks(chunks), Next(0), Failed(false){}
+};
+
+
 /**
  * Constructor
+ * @param file name, lex on demand with bounded memory if streaming is true
+ */
+Parser::Parser(std::string filename, bool streaming)
+    : Parent(NULL), TU(NULL), Arena(NULL), NestingDepth(0), Threads(1), CurPosition(0){
+    Symbols = new StringInterner();
+    if (streaming)
+        Tokens=LexicalAnalysisStream(filename, Symbols);
+    else
+        Tokens=LexicalAnalysisMapped(filename, Symbols);
+}
+
+/**
+ * Constructor
+ * @param tokens lexed with symbols, both are owned by Parser
+ */
+Parser::Parser(TokenStream *tokens, StringInterner *symbols)
+    : Parent(NULL), Symbols(symbols), Tokens(tokens), TU(NULL), Arena(NULL),
+      NestingDepth(0), Threads(1), CurPosition(0){
+}
+
+/**
+ * Constructor of worker Parser
+ * Symbols and tables are read from parent, tokens through a view of its stream
+ * @param parent Parser, arena receiving the nodes
+ */
+Parser::Parser(Parser *parent, llvm::BumpPtrAllocator *arena)
+    : Parent(parent), Symbols(parent->Symbols), Tokens(parent->Tokens->createView()),
+      TU(NULL), Arena(arena),
+      NestingDepth(0), Threads(1), CurPosition(0){
+}
+
+/**
+ * Destructor
  */
-Parser::Parser(std::string filename){
-    Tokens=LexicalAnalysis(filename);
+Parser::~Parser(){
+    SAFE_DELETE(TU);
+    SAFE_DELETE(Tokens);
+    if (!Parent)
+        SAFE_DELETE(Symbols);
+}
+
+/**
+ * Set number of threads parsing function bodies
+ * Ignored in streaming mode, where tokens before the current
+ * declaration are released
+ * @return success: true fail: false
+ */
+bool Parser::setThreads(int threads){
+    if (threads < 1 || (Tokens && Tokens->isStreaming()))
+        return false;
+    Threads = threads;
+    return true;
 }
 
 
@@ -15,7 +78,7 @@ Parser::Parser(std::string filename){
  */
 bool Parser::doParser(){
     if (!Tokens){
-        fprint(stderr, "error ar lexer\n");
+        fprintf(stderr, "error at lexer\n");
         return false;
     }else{
         return visitTranslationUnit();
@@ -30,7 +93,7 @@ TranslationUnitAST &Parser::getAST(){
     if (TU){
         return *TU;
     }else{
-        return *(new TranslationUnitAST());
+        return *(new TranslationUnitAST(Symbols));
     }
 }
 
@@ -39,41 +102,66 @@ TranslationUnitAST &Parser::getAST(){
  * @return success: true fail: false
  */
 bool Parser::visitTranslationUnit(){
-    TU = new TranslationUnitAST();
-    std::vector<std::string> param_list;
-    param_list.push_back("i");
-    TU->addPrototype(new PrototypeAST("printnum", param_list));
-    PrototypeTable["printnum"] = 1;
+    TU = new TranslationUnitAST(Symbols);
+    Arena = &TU->getAllocator();
+    SymbolID printnum_param = SYM_PRINTNUM_PARAM;
+    TU->addPrototype(new (*Arena) PrototypeAST(SYM_PRINTNUM, copyArray(llvm::makeArrayRef(printnum_param))));
+    CurPosition = -1;
+    setTable(PrototypeTable, SYM_PRINTNUM, 1);
+    setVisible(SYM_PRINTNUM);
 
     //ExternalDecl
-    while (true){
+    for (CurPosition=0; ; CurPosition++){
         if (!visitExternalDeclaration(TU)){
             SAFE_DELETE(TU);
+            Arena = NULL;
             return false;
         }
         if (Tokens->getCurType() == TOK_EOF)
             break;
     }
+
+    //Deferred function bodies
+    if (!parseFunctionBodies()){
+        SAFE_DELETE(TU);
+        Arena = NULL;
+        return false;
+    }
     return true;
 }
 
 /**
  * Class of parsing for ExternalDeclaration
+ * The prototype is parsed once, and the following ';' or '{'
+ * decides between declaration and definition
  * Add parsed PrototypeAST and FunctionAST to TranslationUnit
  * @param TranslationUnitAST
- * @return true
+ * @return success: true fail: false
  */
 bool Parser::visitExternalDeclaration(TranslationUnitAST *tunit){
+    //No visit method rewinds before the start of the current declaration
+    if (Threads == 1)
+        Tokens->releaseTokens(Tokens->getCurIndex());
+
+    PrototypeAST *proto = visitPrototype();
+    if (!proto)
+        return false;
+
     //FunctionDeclaration
-    PrototypeAST *proto = visitFunctionDeclaration();
-    if (proto){
+    if (isSymbol(';')){
+        proto = visitFunctionDeclaration(proto);
+        if (!proto)
+            return false;
         tunit->addPrototype(proto);
         return true;
-    }
 
     //FunctionDefinition
-    FunctionAST *func_def = visitFunctionDefinition();
-    if (func_def){
+    }else if (isSymbol('{') && Threads > 1){
+        return deferFunctionDefinition(proto);
+    }else if (isSymbol('{')){
+        FunctionAST *func_def = visitFunctionDefinition(proto);
+        if (!func_def)
+            return false;
         tunit->addFunction(func_def);
         return true;
     }
@@ -83,220 +171,291 @@ bool Parser::visitExternalDeclaration(TranslationUnitAST *tunit){
 
 /**
  * Parsing method for FunctionDeclaration
+ * @param prototype followed by ';'
  * @return success: PrototypeAST fail: NULL
  */
-PrototypeAST *Parser::visitFunctionDeclaration(){
-    int bkup = Tokens->getCurIndex();
-    PrototypeAST *proto = visitPrototype();
-    if (!proto){
+PrototypeAST *Parser::visitFunctionDeclaration(PrototypeAST *proto){
+    if (lookupTable(PrototypeTable, proto->getName()) != -1 ||
+            (lookupTable(FunctionTable, proto->getName()) != -1 &&
+             lookupTable(FunctionTable, proto->getName()) != proto->getParamNum())){
+        fprintf(stderr, "Function : %s is redefined",
+                Symbols->getName(proto->getName()).c_str());
         return NULL;
     }
+    setTable(PrototypeTable, proto->getName(), proto->getParamNum());
+    setVisible(proto->getName());
 
-    //prototype
-    if (Tokens->getCurString() == ";"){
-        if (PrototypeTable.find(proto->getName()) != PrototypeTable.end() ||
-                (FunctionTable.find(proto->getName()) != FunctionTable.end() && 
-                 FunctionTable[proto->getName()] != proto->getParamNum())){
-            fprint(stderr, "Function : %s is redefined", proto->getName().c_str());
-            SAFE_DELETE(proto);
-            return NULL;
-        }
-        PrototypeTable[proto->getName()] = proto->getParamNum();
-        Tokens->getNextToken();
-        return proto;
-    }else{
-        SAFE_DELETE(proto);
-        Tokens->applyTokenIndex(bkup);
-        return NULL;
-    }
+    //';'
+    Tokens->getNextToken();
+    return proto;
 }
 
 /**
  * Parsing method for FunctionDefinition
+ * @param prototype followed by '{'
  * @return success: FunctionAST fail: NULL
  */
-FunctionAST *Parser::visitFunctionDefinition(){
-    int bkup = Tokens->getCurIndex();
-
-    PrototypeAST *proto = visitPrototype();
-    if (!proto){
-        return NULL;
-    }else if ((PrototypeTable.find(proto->getName()) != PrototypeTable.end() &&
-                PrototypeTable[proto->getName()] != proto->getParamNum()) ||
-            FunctionTable.find(proto->getName() != FunctionTable.end())){
-        fprint(stderr, "Function : %s is redefined", proto->getName().c_str());
-        SAFE_DELETE(proto);
+FunctionAST *Parser::visitFunctionDefinition(PrototypeAST *proto){
+    if (!checkFunctionDefinition(proto))
         return NULL;
-    }
 
-    VariableTable.clear();
+    Variables.pushScope();
     FunctionStmtAST *func_stmt = visitFunctionStatement(proto);
+    Variables.popScope();
     if (func_stmt){
-        FunctionTable[proto->getName()] = proto->getParamNum();
-        return new FunctionAST(proto, func_stmt);
+        setTable(FunctionTable, proto->getName(), proto->getParamNum());
+        setVisible(proto->getName());
+        return new (*Arena) FunctionAST(proto, func_stmt);
     }else{
-        SAFE_DELETE(proto);
-        Tokens->applyTokenIndex(bkup);
         return NULL;
     }
 }
 
+/**
+ * Check that a function definition agrees with earlier declarations
+ * @return valid: true redefined: false
+ */
+bool Parser::checkFunctionDefinition(PrototypeAST *proto){
+    if ((lookupTable(PrototypeTable, proto->getName()) != -1 &&
+                lookupTable(PrototypeTable, proto->getName()) != proto->getParamNum()) ||
+            lookupTable(FunctionTable, proto->getName()) != -1){
+        fprintf(stderr, "Function : %s is redefined",
+                Symbols->getName(proto->getName()).c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Register function definition and skip its body, which is parsed
+ * later by parseFunctionBodies
+ * A body contains no braces, so it ends at the first '}'
+ * @param prototype followed by '{'
+ * @return success: true fail: false
+ */
+bool Parser::deferFunctionDefinition(PrototypeAST *proto){
+    if (!checkFunctionDefinition(proto))
+        return false;
+
+    BodyJob job;
+    job.Proto = proto;
+    job.Begin = Tokens->getCurIndex();
+    job.Position = CurPosition;
+    job.Result = NULL;
+    if (!Tokens->skipToSymbol('}'))
+        return false;
+    job.End = Tokens->getCurIndex();
+    Tokens->getNextToken();
+
+    BodyJobs.push_back(job);
+    setTable(FunctionTable, proto->getName(), proto->getParamNum());
+    setVisible(proto->getName());
+    return true;
+}
+
+/**
+ * Parse the deferred function bodies and add them to TU in source order
+ * Bodies are split into chunks of consecutive functions, which worker
+ * threads take in turn; each worker has its own arena and token view
+ * @return success: true fail: false
+ */
+bool Parser::parseFunctionBodies(){
+    if (BodyJobs.empty())
+        return true;
+
+    //Chunks of about the same number of tokens, several per thread
+    static const int MinChunkTokens = 4096;
+    int total = 0;
+    for (int i=0; i<BodyJobs.size(); i++)
+        total += BodyJobs[i].End - BodyJobs[i].Begin + 1;
+    int chunk_tokens = std::max(total / (Threads * 4), MinChunkTokens);
+
+    std::vector<int> chunks;    //Index of the first job of each chunk
+    int size = chunk_tokens;
+    for (int i=0; i<BodyJobs.size(); i++){
+        if (size >= chunk_tokens){
+            chunks.push_back(i);
+            size = 0;
+        }
+        size += BodyJobs[i].End - BodyJobs[i].Begin + 1;
+    }
+    chunks.push_back(BodyJobs.size());
+
+    BodyQueue queue(chunks);
+    int num_workers = std::min(Threads, (int)chunks.size() - 1);
+    std::vector<llvm::BumpPtrAllocator*> arenas(num_workers);
+    for (int i=0; i<num_workers; i++)
+        arenas[i] = new llvm::BumpPtrAllocator();
+
+    //The calling thread is worker 0
+    std::vector<std::thread> threads;
+    for (int i=1; i<num_workers; i++)
+        threads.push_back(std::thread(&Parser::runBodyWorker, this, &queue, arenas[i]));
+    runBodyWorker(&queue, arenas[0]);
+    for (int i=0; i<threads.size(); i++)
+        threads[i].join();
+
+    for (int i=0; i<num_workers; i++)
+        TU->adoptAllocator(arenas[i]);
+    if (queue.Failed)
+        return false;
+
+    for (int i=0; i<BodyJobs.size(); i++)
+        TU->addFunction(BodyJobs[i].Result);
+    BodyJobs.clear();
+    return true;
+}
+
+/**
+ * Take chunks from queue until it is empty, parsing them on a worker Parser
+ * @param queue shared by the threads, arena of this thread
+ */
+void Parser::runBodyWorker(BodyQueue *queue, llvm::BumpPtrAllocator *arena){
+    Parser worker(this, arena);
+    int num_chunks = queue->Chunks.size() - 1;
+    while (!queue->Failed){
+        int chunk = queue->Next++;
+        if (chunk >= num_chunks)
+            break;
+        if (!worker.parseBodyChunk(&BodyJobs[queue->Chunks[chunk]],
+                    &BodyJobs[queue->Chunks[chunk + 1] - 1]))
+            queue->Failed = true;
+    }
+}
+
+/**
+ * Parse function bodies of jobs first to last (worker Parser)
+ * @return success: true fail: false
+ */
+bool Parser::parseBodyChunk(BodyJob *first, BodyJob *last){
+    if (!Tokens)
+        return false;
+
+    for (BodyJob *job=first; job<=last; job++){
+        Tokens->applyTokenIndex(job->Begin);
+        CurPosition = job->Position;
+        Variables.pushScope();
+        FunctionStmtAST *func_stmt = visitFunctionStatement(job->Proto);
+        Variables.popScope();
+        if (!func_stmt || Tokens->getCurIndex() != job->End + 1)
+            return false;
+        job->Result = new (*Arena) FunctionAST(job->Proto, func_stmt);
+    }
+    return true;
+}
+
 /**
  * Parsing method for Prototype
  * @return success: PrototypeAST fail: NULL
  */
 PrototypeAST *Parser::visitPrototype(){
-    std::string func_name;
-
-    int bkup = Tokens->getCurIndex();
+    SymbolID func_name;
 
     //type_specifier
-    if (Tokens->getCurType() == TOK_INT){
-        Tokens->getNextToken();
-    }else{
+    if (Tokens->getCurType() != TOK_INT)
         return NULL;
-    }
+    Tokens->getNextToken();
 
     //IDENTIFIER
-    if (Tokens->getCurType() == TOK_IDENTIFIER){
-        func_name = Tokens->getCurString();
-        Tokens->getNextToken();
-    }else{
-        Tokens->ungetToken(1);
+    if (Tokens->getCurType() != TOK_IDENTIFIER)
         return NULL;
-    }
+    func_name = Tokens->getCurSymbol();
+    Tokens->getNextToken();
 
     //'('
-    if (Tokens->getCurString() == "("){
-        Tokens->getNextToken();
-    }else{
-        Tokens->ungetToken(2);
+    if (!isSymbol('('))
         return NULL;
-    }
+    Tokens->getNextToken();
 
     //parameter_list
-    std::vector<std::string> param_list;
-    bool is_first_param = true;
-    while (true){
+    llvm::SmallVector<SymbolID, 8> param_list;
+    while (Tokens->getCurType() == TOK_INT){
+        Tokens->getNextToken();
+
+        if (Tokens->getCurType() != TOK_IDENTIFIER)
+            return NULL;
+        param_list.push_back(Tokens->getCurSymbol());
+        Tokens->getNextToken();
+
         //','
-        if (!is_first_param && Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == ","){
-            Tokens->getNextToken();
-        }
-        if (Tokens->getCurType() == TOK_INT){
-            Tokens->getNextToken();
-        }else{
+        if (!isSymbol(','))
             break;
-        }
-
-        if (Tokens->getCurType() == TOK_IDENTIFIER){
-            if (std::find(param_list.begin(), param_list.end(), Tokens->getCurString()) != param_list.end()){
-                Tokens->applyTokenIndex(bkup);
-                return NULL;
-            }
-            param_list.push_back(Tokens->getCurString());
-            Tokens->getNextToken();
-        }else{
-            Tokens->applyTokenIndex(bkup);
+        Tokens->getNextToken();
+        if (Tokens->getCurType() != TOK_INT)
             return NULL;
-        }
-        is_first_param = false;
     }
 
     //')'
-    if (Tokens->getCurString() == ")"){
-        Tokens->getNextToken();
-        return new PrototypeAST(func_name, param_list);
-    }else{
-        Tokens->applyTokenIndex(bkup);
+    if (!isSymbol(')'))
         return NULL;
-    }
-
+    Tokens->getNextToken();
+
+    //Parameter names are distinct
+    bool distinct = true;
+    Variables.pushScope();
+    for (int i=0; distinct && i<param_list.size(); i++)
+        distinct = Variables.declare(param_list[i], NULL);
+    Variables.popScope();
+    if (!distinct)
+        return NULL;
+    return new (*Arena) PrototypeAST(func_name, copyArray<SymbolID>(param_list));
 }
 
 /**
  * Parsing method for FunctionStatement
+ * Declarations are added to the innermost scope of Variables, which
+ * the caller opens and closes
  * @param Instance of Prototype class which has function name and arguments
  * @return success: FunctionStmtAST fail: NULL
  */
 FunctionStmtAST *Parser::visitFunctionStatement(PrototypeAST *proto){
-    int bkup = Tokens->getCurIndex();
-
     //{
-    if (Tokens->getCurString() == "{"){
-        Tokens->getNextToken();
-    }else{
+    if (!isSymbol('{'))
         return NULL;
-    }
+    Tokens->getNextToken();
 
-    //Create FunctionStatement
-    FunctionStmtAST *func_stmt = new FunctionStmtAST();
+    //Declarations and statements are gathered here and copied into the arena
+    DeclBuffer.clear();
+    StmtBuffer.clear();
 
     //Add parameter to FunctionStatement
     for (int i=0; i<proto->getParamNum(); i++){
-        VariableDeclAST *vdecl = new VariableDeclAST(proto->getParamName(i));
+        VariableDeclAST *vdecl = new (*Arena) VariableDeclAST(proto->getParamName(i));
         vdecl->setDeclType(VariableDeclAST::param);
-        func_stmt->addVariableDeclaration(vdecl);
-        VariableTable.push_back(vdecl->getName());
+        if (!Variables.declare(vdecl->getName(), vdecl))
+            return NULL;
+        DeclBuffer.push_back(vdecl);
     }
 
-    VariableDeclAST *var_decl;
-    BaseAST *stmt;
-    BaseAST *last_stmt;
-
-    //{statement_list}
-    if (stmt = visitStatement()){
-        while (stmt){
-            last_stmt = stmt;
-            func_stmt->addStatement(stmt);
-            stmt = visitStatement();
-        }
-
     //variable_declaration_list
-    }else if (var_decl = visitVariableDeclaration()){
-        while (var_decl){
-            var_decl->setDeclType(VariableDeclAST::local);
-            if (std::find(VariableTable.begin(), VariableTable.end(), var_decl->getName()) != VariableTable.end()){
-                SAFE_DELETE(var_decl);
-                SAFE_DELETE(func_stmt);
-                return NULL;
-            }
-            func_stmt->addVariableDeclaration(var_decl);
-            VariableTable.push_back(var_decl->getName());
-            //Parse VariableDeclaration
-            var_decl = visitVariableDeclaration();
-        }
-
-        if (stmt = visitStatement()){
-            while (stmt){
-                last_stmt = stmt;
-                func_stmt->addStatement(stmt);
-                stmt = visitStatement();
-            }
-        }
-
+    while (Tokens->getCurType() == TOK_INT){
+        VariableDeclAST *var_decl = visitVariableDeclaration();
+        if (!var_decl || !Variables.declare(var_decl->getName(), var_decl))
+            return NULL;
+        var_decl->setDeclType(VariableDeclAST::local);
+        DeclBuffer.push_back(var_decl);
+    }
 
-    //other
-    }else{
-        SAFE_DELETE(func_stmt);
-        Tokens->applyTokenIndex(bkup);
-        return NULL;
+    //statement_list
+    BaseAST *last_stmt = NULL;
+    while (!isSymbol('}') && Tokens->getCurType() != TOK_EOF){
+        BaseAST *stmt = visitStatement();
+        if (!stmt)
+            return NULL;
+        last_stmt = stmt;
+        StmtBuffer.push_back(stmt);
     }
 
     //check if last statement is jump_statement
-    if (!last_stmt || !llvm::isa<JumpStmtAST>(last_stmt)){
-        SAFE_DELETE(func_stmt);
-        Tokens->applyTokenIndex(bkup);
+    if (!last_stmt || !llvm::isa<JumpStmtAST>(last_stmt))
         return NULL;
-    }
 
     //}
-    if (Tokens->getCurString() == "}"){
-        Tokens->getNextToken();
-        return func_stmt;
-    }else{
-        SAFE_DELETE(func_stmt);
+    if (!isSymbol('}'))
         return NULL;
-    }
+    Tokens->getNextToken();
+    return new (*Arena) FunctionStmtAST(copyArray<VariableDeclAST*>(DeclBuffer),
+            copyArray<BaseAST*>(StmtBuffer));
 }
 
 
@@ -305,32 +464,24 @@ FunctionStmtAST *Parser::visitFunctionStatement(PrototypeAST *proto){
  * @return success: VariableDeclAST fail: NULL
  */
 VariableDeclAST *Parser::visitVariableDeclaration(){
-    std::string name;
+    SymbolID name;
 
     //INT
-    if (Tokens->getCurType() == TOK_INT){
-        Tokens->getNextToken();
-    }else{
+    if (Tokens->getCurType() != TOK_INT)
         return NULL;
-    }
+    Tokens->getNextToken();
 
     //IDENTIFIER
-    if (Tokens->getCurType() == TOK_IDENTIFIER){
-        name = Tokens->getCurString();
-        Tokens->getNextToken();
-    }else{
-        Tokens->ungetToken(1);
+    if (Tokens->getCurType() != TOK_IDENTIFIER)
         return NULL;
-    }
+    name = Tokens->getCurSymbol();
+    Tokens->getNextToken();
 
     //';'
-    if (Tokens->getCurString() == ";"){
-        Tokens->getNextToken();
-        return new VariableDeclAST(name);
-    }else{
-        Tokens->ungetToken(2);
+    if (!isSymbol(';'))
         return NULL;
-    }
+    Tokens->getNextToken();
+    return new (*Arena) VariableDeclAST(name);
 }
 
 /**
@@ -338,14 +489,10 @@ VariableDeclAST *Parser::visitVariableDeclaration(){
  * @return success: BaseAST fail: NULL
  */
 BaseAST *Parser::visitStatement(){
-    BaseAST *stmt = NULL;
-    if (stmt = visitExpressionStatement()){
-        return stmt;
-    }else if (stmt = visitJumpStatement()){
-        return stmt;
-    }else{
-        return NULL;
-    }
+    if (Tokens->getCurType() == TOK_RETURN)
+        return visitJumpStatement();
+    else
+        return visitExpressionStatement();
 }
 
 /**
@@ -353,19 +500,19 @@ BaseAST *Parser::visitStatement(){
  * @return success: BaseAST fail: NULL
  */
 BaseAST *Parser::visitExpressionStatement(){
-    BaseAST *assign_expr;
-
     //NULL Expression
-    if (Tokens->getCurString() == ";"){
+    if (isSymbol(';')){
         Tokens->getNextToken();
-        return new NullExprAST();
-    }else if((assign_expr = visitAssignmentExpression())){
-        if (Tokens->getCurString() == ";"){
-            Tokens->getNextToken();
-            return assign_expr;
-        }
+        return new (*Arena) NullExprAST();
     }
-    return NULL;
+
+    BaseAST *assign_expr = visitAssignmentExpression();
+    if (!assign_expr)
+        return NULL;
+    if (!isSymbol(';'))
+        return NULL;
+    Tokens->getNextToken();
+    return assign_expr;
 }
 
 /**
@@ -373,294 +520,258 @@ BaseAST *Parser::visitExpressionStatement(){
  * @return success: BaseAST fail: NULL
  */
 BaseAST *Parser::visitJumpStatement(){
-    int bkup = Tokens->getCurIndex();
-    BaseAST *expr;
+    //RETURN
+    if (Tokens->getCurType() != TOK_RETURN)
+        return NULL;
+    Tokens->getNextToken();
 
-    if (Tokens->getCurType() == TOK_RETURN){
-        Tokena->getNextToken();
-        if (!(expr = visitAssignmentExpression())){
-            Tokens->applyTokenIndex(bkup);
-            return NULL;
-        }
+    BaseAST *expr = visitAssignmentExpression();
+    if (!expr)
+        return NULL;
 
-        if (Tokens->getCurString() == ";"){
-            Tokens->getNextToken();
-            return new JumpStmtAST(expr);
-        }else{
-            Tokens->applyTokenIndex(bkup);
-            return NULL;
-        }
-    }else{
+    //';'
+    if (!isSymbol(';'))
         return NULL;
-    }
+    Tokens->getNextToken();
+    return new (*Arena) JumpStmtAST(expr);
 }
 
 
 /**
  * Parsing method for AssignmentExpression
+ * An identifier is the left side of an assignment only when the next
+ * token is '=', which is decided by one token of lookahead
  * @return success: BaseAST fail: NULL
  */
 BaseAST *Parser::visitAssignmentExpression(){
-    int bkup = Tokens->getCurIndex();
-
     // | IDENTIFIER '=' additive_expression
-    BaseAST *lhs;
-    if (Tokens->getCurType() == TOK_IDENTIFIER){
-        //Comfirm if variable has been defined
-        if (std::find(VariableTable.begin(), VariableTable.end(), Tokens->getCurString()) != VariableTable.end()){
-            lhs = new VariableAST(Tokens->getCurString());
+    VariableDeclAST *decl;
+    if (Tokens->getCurType() == TOK_IDENTIFIER && (decl = Variables.lookup(Tokens->getCurSymbol()))){
+        Token next = Tokens->peekToken();
+        if (next.getTokenType() == TOK_SYMBOL && next.getTokenRef() == "="){
+            BaseAST *lhs = new (*Arena) VariableAST(Tokens->getCurSymbol(), decl);
             Tokens->getNextToken();
-            BaseAST *rhs;
-            if (Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString == "="){
-                Tokens->getNextToken();
-                if (rhs = visitAdditiveExpression(NULL)){
-                    return new BinaryExprAST("=", lhs, rhs);
-                }else{
-                    SAFE_DELETE(lhs);
-                    Tokens->applyTokenIndex(bkup);
-                }
-            }else{
-                SAFE_DELETE(lhs);
-                Tokens->applyTokenIndex(bkup);
-            }
-        }else{
-            Tokens->applyTokenIndex(bkup);
+            Tokens->getNextToken();
+
+            BaseAST *rhs = visitBinaryExpression(0);
+            if (!rhs)
+                return NULL;
+            return new (*Arena) BinaryExprAST("=", lhs, rhs);
         }
     }
 
     //additive_expression
-    BaseAST *add_expr = visitAdditiveExpression(NULL);
-    if (add_expr){
-        return add_expr;
-    }
-    
-    return NULL;
-
+    return visitBinaryExpression(0);
 }
 
+
 /**
- * Parsing method for AdditiveExpression
- * @param lhs (NULL in initial call)
- * @return success: BaseAST fail: NULL
+ * Precedence and spelling of binary operator
+ * The spelling is a string literal, which outlives the TokenStream
+ * @return precedence, -1 if op is not a binary operator
  */
-BaseAST *Parser::visitAdditiveExpression(BaseAST *lhs){
-    int bkup = Tokens->getCurIndex();
-
-    if (!lhs){
-        lhs = visitMultiplicativeExpression(NULL);
+static int getBinaryPrecedence(llvm::StringRef op, llvm::StringRef &spelling){
+    if (op.size() != 1)
+        return -1;
+    switch (op[0]){
+        case '+':
+            spelling = "+";
+            return 10;
+        case '-':
+            spelling = "-";
+            return 10;
+        case '*':
+            spelling = "*";
+            return 20;
+        case '/':
+            spelling = "/";
+            return 20;
+        default:
+            return -1;
     }
-    BaseAST *rhs;
-
-    if (!lhs){
-        return NULL;
-    }
-
-    //+
-    if (Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "+"){
-        Tokens->getNextToken();
-        rhs = visitMultiplicativeExpression(NULL);
-        if (rhs){
-            return visitAdditiveExpression(new BinaryExprAST("+", lhs, rhs));
-        }else{
-            SAFE_DELETE(lhs);
-            Tokens->applyTokenIndex(bkup);
-            return NULL;
-        }
-    //-
-    }else if (Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "-"){
-        Tokens->getNextToken();
-        rhs = visitMultiplicativeExpression(NULL);
-        if (rhs){
-            return visitAdditiveExpression(new BinaryExprAST("-", lhs, rhs));
-        }else{
-            SAFE_DELETE(lhs);
-            Tokens->applyTokenIndex(bkup);
-            return NULL;
-        }
-    }
-    return lhs;
-    
 }
 
 /**
- * MultiplicativeExpression
- * @param lhs
- * @return BaseAST, NULL
+ * Parsing method for AdditiveExpression and MultiplicativeExpression
+ * Operator precedence parsing: operators binding tighter than min_prec
+ * are folded into the left hand side, all of them left associative
+ * A chain of operators is folded by the loop, the recursion depth is
+ * bounded by the number of precedence levels and not by its length
+ * @param lowest precedence accepted (0 for a whole expression)
+ * @return success: BaseAST fail: NULL
  */
-BaseAST *Parser::visitMultiplicativeExpression(BaseAST *lhs){
-    int bkup = Tokens->getCurIndex();
-
-    if (!lhs){
-        lhs = visitPostfixExpression();
-    }
-    BaseAST *rhs;
-
-    if (!lhs){
+BaseAST *Parser::visitBinaryExpression(int min_prec){
+    BaseAST *lhs = visitPostfixExpression();
+    if (!lhs)
         return NULL;
-    }
 
-    //*
-    if (Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "*"){
+    while (Tokens->getCurType() == TOK_SYMBOL){
+        llvm::StringRef op;
+        int prec = getBinaryPrecedence(Tokens->getCurRef(), op);
+        if (prec < min_prec)
+            break;
         Tokens->getNextToken();
-        rhs = visitPostfixExpression();
-        if (rhs){
-            return visitMultiplicativeExpression(new BinaryExprAST("*", lhs, rhs));
-        }else{
-            SAFE_DELETE(lhs);
-            Tokens->applyTokenIndex(bkup);
-            return NULL;
-        }
 
-    // /
-    }else if (Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString == "/"){
-        Tokens->getNextToken();
-        rhs = visitPostfixExpression();
-        if (rhs){
-            return visitMultiplicativeExpression(new BinaryExprAST("/", lhs, rhs));
-        }else{
-            SAFE_DELETE(lhs);
-            Tokens->applyTokenIndex(bkup);
+        BaseAST *rhs = visitBinaryExpression(prec + 1);
+        if (!rhs)
             return NULL;
-        }
+        lhs = new (*Arena) BinaryExprAST(op, lhs, rhs);
     }
     return lhs;
 }
 
 /**
  * PostfixExpression
+ * An identifier which is not a variable is a function call
  */
 BaseAST *Parser::visitPostfixExpression(){
-    int bkup = Tokens->getCurIndex();
-
     //primary_expression
-    BaseAST *prim_expr = visitPrimaryExpression();
-    if (prim_expr){
-        return prim_expr;
-    }
+    if (Tokens->getCurType() != TOK_IDENTIFIER || isVariable(Tokens->getCurSymbol()))
+        return visitPrimaryExpression();
 
     //FUNCTION_IDENTIFIER
-    if (Tokens->getCurType() == TOK_IDENTIFIER){
-        //is FUNCTION_IDENTIFIER
-        int param_num;
-        if (PrototypeTable.find(Tokens->getCurString()) != PrototypeTable.end()){
-            param_num = PrototypeTable[Tokens->getCurString();
-        }else if (FunctionTable.find(Tokens->getCurString()) != FunctionTable.end()){
-            param_num = FunctionTable[Tokens->getCurString()];
-        }else{
-            return NULL;
-        }
-
-        //Get function name
-        std::string Callee = Tokens->getCurString();
-        Tokens->getNextToken();
-
-        //LEFT PALEN
-        if (Tokens->getCurType() != TOK_SYMBOL || Tokens->getCurString() != "("){
-            Tokens->applyTokenIndex(bkup);
-            return NULL;
-        }
+    int param_num = lookupCallee(Tokens->getCurSymbol());
+    if (param_num == -1)
+        return NULL;
 
-        Tokens->getNextToken();
-        //argument list
-        std::vector<BaseAST*> args;
-        BaseAST *assign_expr = visitAssignmentExpression();
-        if (assign_expr){
-            args.push_back(assign_expr);
-            while (Tokens->getCurString() == TOK_SYMBOL && Tokens->getCurString() == ","){
-                Tokens->getNextToken();
-
-                //IDENTIFIER
-                assign_expr = visitAssignmentExpression();
-                if (assign_expr){
-                    args.push_back(assign_expr);
-                }else{
-                    break;
-                }
-            }
-        }
+    //Get function name
+    SymbolID Callee = Tokens->getCurSymbol();
+    Tokens->getNextToken();
 
-        //Confirm the number of arguments
-        if (args.size() != param_num){
-            for (int i=0; i<args.size(); i++){
-                SAFE_DELETE(args[i]);
+    //LEFT PALEN
+    if (!isSymbol('('))
+        return NULL;
+    Tokens->getNextToken();
+
+    //argument list
+    llvm::SmallVector<BaseAST*, 8> args;
+    bool success = true;
+    if (!isSymbol(')')){
+        while (true){
+            BaseAST *assign_expr = visitNestedExpression();
+            if (!assign_expr){
+                success = false;
+                break;
             }
-            Tokens->applyTokenIndex(bkup);
-            return NULL;
-        }
+            args.push_back(assign_expr);
 
-        //RIGHT PALEN
-        if (Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == ")"){
+            if (!isSymbol(','))
+                break;
             Tokens->getNextToken();
-            return new CallExprAST(Callee, args);
-        }else{
-            for (int i=0; i<args.size(); i++){
-                SAFE_DELETE(args[i]);
-            }
-            Tokens->applyTokenIndex(bkup);
-            return NULL;
         }
-
-    }else{
-        return NULL;
     }
 
+    //Confirm the number of arguments and RIGHT PALEN
+    if (success && args.size() == param_num && isSymbol(')')){
+        Tokens->getNextToken();
+        return new (*Arena) CallExprAST(Callee, copyArray<BaseAST*>(args));
+    }
+    return NULL;
 }
 
 /**
  * PrimaryExpression
  */
 BaseAST *Parser::visitPrimaryExpression(){
-    int bkup = Tokens->getCurIndex();
-
     //VARIABLE_IDENTIFIER
-    if (Tokens->getCurType() == TOK_IDENTIFIER && (std::find(VariableTable.begin(), VariableTable.end(), Tokens->getCurString()) != VariableTable.end())){
-        std::string var_name = Tokens->getCurString();
+    VariableDeclAST *decl;
+    if (Tokens->getCurType() == TOK_IDENTIFIER && (decl = Variables.lookup(Tokens->getCurSymbol()))){
+        SymbolID var_name = Tokens->getCurSymbol();
         Tokens->getNextToken();
-        return new VariableAST(var_name);
-    
+        return new (*Arena) VariableAST(var_name, decl);
+
     //integer
     }else if (Tokens->getCurType() == TOK_DIGIT){
-        int var = Tokens->getCurNumVal();
+        int val = Tokens->getCurNumVal();
         Tokens->getNextToken();
-        return new NumberAST(val);
-    
+        return new (*Arena) NumberAST(val);
+
     //integer(-)
-    }else if (Tokens->getCurType() == TOK_SYMBOL && Toknes->getCurString() == "-"){
+    }else if (isSymbol('-')){
         Tokens->getNextToken();
-        if (Tokens->getCurType() == TOK_DIGIT){
-            int val = Tokens->getCurNumVal();
-            Tokens->getNextToken();
-            return new NumberAST(-val);
-        }else{
-            Tokens->applyTokenIndex(bkup);
+        if (Tokens->getCurType() != TOK_DIGIT)
             return NULL;
-        }
+        int val = Tokens->getCurNumVal();
+        Tokens->getNextToken();
+        return new (*Arena) NumberAST(-val);
 
     //'(' expression ')'
-    }else if (Tokens->getCurType() == TOK_SYMBOL && Tokens->getCurString() == "("){
+    }else if (isSymbol('(')){
         Tokens->getNextToken();
 
         //expression
-        BaseAST *assign_expr;
-        if (!(assign_expr = visitAssignmentExpression())){
-            Tokens->applyTokenIndex(bkup);
+        BaseAST *assign_expr = visitNestedExpression();
+        if (!assign_expr)
             return NULL;
-        }
 
         //RIGHT PALEN
-        if (Tokens->getCurString() == ")"){
-            Tokens->getNextToken();
-            return assign_expr;
-        }else{
-            SAFE_DELETE(assign_expr);
-            Tokens->applyTokenIndex(bkup);
+        if (!isSymbol(')'))
             return NULL;
-        }
-
+        Tokens->getNextToken();
+        return assign_expr;
     }
 
     return NULL;
+}
 
+
+/**
+ * Expression in parentheses or argument list
+ * @return success: BaseAST fail: NULL (also when nested too deeply)
+ */
+BaseAST *Parser::visitNestedExpression(){
+    if (NestingDepth >= MaxNestingDepth){
+        fprintf(stderr, "error: expression nested deeper than %d\n", MaxNestingDepth);
+        return NULL;
+    }
+    NestingDepth++;
+    BaseAST *expr = visitAssignmentExpression();
+    NestingDepth--;
+    return expr;
 }
 
 
+/**
+ * Look up number of parameters in PrototypeTable or FunctionTable
+ * @return number of parameters, -1 if name is not declared
+ */
+int Parser::lookupTable(std::vector<int> &table, SymbolID name){
+    if (name < table.size())
+        return table[name];
+    return -1;
+}
+
+/**
+ * Register number of parameters to PrototypeTable or FunctionTable
+ */
+bool Parser::setTable(std::vector<int> &table, SymbolID name, int param_num){
+    if (name >= table.size())
+        table.resize(Symbols->size(), -1);
+    table[name] = param_num;
+    return true;
+}
+
+/**
+ * Make function callable from the declarations after the current one
+ */
+bool Parser::setVisible(SymbolID name){
+    if (name >= VisibleFrom.size())
+        VisibleFrom.resize(Symbols->size(), INT_MAX);
+    if (CurPosition < VisibleFrom[name])
+        VisibleFrom[name] = CurPosition;
+    return true;
+}
+
+/**
+ * Look up function called from the current declaration
+ * @return number of parameters, -1 if name is not declared before
+ */
+int Parser::lookupCallee(SymbolID name){
+    Parser *tables = Parent ? Parent : this;
+    if (name >= tables->VisibleFrom.size() || tables->VisibleFrom[name] >= CurPosition)
+        return -1;
+    int param_num = lookupTable(tables->PrototypeTable, name);
+    if (param_num == -1)
+        param_num = lookupTable(tables->FunctionTable, name);
+    return param_num;
+}
@@ -0,0 +1,350 @@
+#include "scan.hpp"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+
+#define S CHAR_SPACE
+#define A CHAR_ALPHA
+#define D CHAR_DIGIT
+const unsigned char CharClassTable[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, S, S, S, S, S, 0, 0,     //0x00
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     //0x10
+    S, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     //0x20
+    D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0,     //0x30
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,     //0x40
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0,     //0x50
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,     //0x60
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0      //0x70
+};
+#undef S
+#undef A
+#undef D
+
+
+/****************************************
+ * Scalar
+ * *************************************/
+
+static const char *skipSpaceScalar(const char *cur, const char *end, int &lines){
+    while (cur < end && isSpaceChar(*cur)){
+        if (*cur == '\n')
+            lines++;
+        cur++;
+    }
+    return cur;
+}
+
+static const char *skipAlnumScalar(const char *cur, const char *end){
+    while (cur < end && isAlnumChar(*cur))
+        cur++;
+    return cur;
+}
+
+static const char *skipDigitScalar(const char *cur, const char *end){
+    while (cur < end && isDigitChar(*cur))
+        cur++;
+    return cur;
+}
+
+static const char *findCommentEndScalar(const char *cur, const char *end, int &lines){
+    while (cur + 1 < end){
+        if (cur[0] == '*' && cur[1] == '/')
+            return cur;
+        if (*cur == '\n')
+            lines++;
+        cur++;
+    }
+    if (cur < end && *cur == '\n')
+        lines++;
+    return end;
+}
+
+static const Scanner ScalarScanner = {
+    skipSpaceScalar,
+    skipAlnumScalar,
+    skipDigitScalar,
+    findCommentEndScalar
+};
+
+
+#ifdef SCAN_X86
+
+/****************************************
+ * SSE2 (16 bytes)
+ * *************************************/
+
+/**
+ * 0xff where lo <= x <= lo + width (unsigned)
+ */
+static inline __m128i inRange16(__m128i x, char lo, char width){
+    __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(width)), d);
+}
+
+static inline unsigned spaceMask16(__m128i x){
+    return _mm_movemask_epi8(_mm_or_si128(
+                _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), inRange16(x, '\t', 4)));
+}
+
+static inline unsigned digitMask16(__m128i x){
+    return _mm_movemask_epi8(inRange16(x, '0', 9));
+}
+
+static inline unsigned alnumMask16(__m128i x){
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    return _mm_movemask_epi8(_mm_or_si128(
+                inRange16(lower, 'a', 25), inRange16(x, '0', 9)));
+}
+
+static inline unsigned newlineMask16(__m128i x){
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+}
+
+static const char *skipSpaceSSE2(const char *cur, const char *end, int &lines){
+    while (end - cur >= 16){
+        __m128i x = _mm_loadu_si128((const __m128i*)cur);
+        unsigned other = ~spaceMask16(x) & 0xffff;
+        unsigned newline = newlineMask16(x);
+        if (other){
+            int n = __builtin_ctz(other);
+            lines += __builtin_popcount(newline & ((1u << n) - 1));
+            return cur + n;
+        }
+        lines += __builtin_popcount(newline);
+        cur += 16;
+    }
+    return skipSpaceScalar(cur, end, lines);
+}
+
+static const char *skipAlnumSSE2(const char *cur, const char *end){
+    while (end - cur >= 16){
+        unsigned other = ~alnumMask16(_mm_loadu_si128((const __m128i*)cur)) & 0xffff;
+        if (other)
+            return cur + __builtin_ctz(other);
+        cur += 16;
+    }
+    return skipAlnumScalar(cur, end);
+}
+
+static const char *skipDigitSSE2(const char *cur, const char *end){
+    while (end - cur >= 16){
+        unsigned other = ~digitMask16(_mm_loadu_si128((const __m128i*)cur)) & 0xffff;
+        if (other)
+            return cur + __builtin_ctz(other);
+        cur += 16;
+    }
+    return skipDigitScalar(cur, end);
+}
+
+static const char *findCommentEndSSE2(const char *cur, const char *end, int &lines){
+    while (end - cur >= 17){
+        __m128i x0 = _mm_loadu_si128((const __m128i*)cur);
+        __m128i x1 = _mm_loadu_si128((const __m128i*)(cur + 1));
+        unsigned found = _mm_movemask_epi8(_mm_and_si128(
+                    _mm_cmpeq_epi8(x0, _mm_set1_epi8('*')),
+                    _mm_cmpeq_epi8(x1, _mm_set1_epi8('/'))));
+        unsigned newline = newlineMask16(x0);
+        if (found){
+            int n = __builtin_ctz(found);
+            lines += __builtin_popcount(newline & ((1u << n) - 1));
+            return cur + n;
+        }
+        lines += __builtin_popcount(newline);
+        cur += 16;
+    }
+    return findCommentEndScalar(cur, end, lines);
+}
+
+static const Scanner SSE2Scanner = {
+    skipSpaceSSE2,
+    skipAlnumSSE2,
+    skipDigitSSE2,
+    findCommentEndSSE2
+};
+
+
+/****************************************
+ * AVX2 (32 bytes)
+ * *************************************/
+
+#define AVX2_FUNC __attribute__((target("avx2")))
+
+AVX2_FUNC static inline __m256i inRange32(__m256i x, char lo, char width){
+    __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(width)), d);
+}
+
+AVX2_FUNC static inline unsigned spaceMask32(__m256i x){
+    return _mm256_movemask_epi8(_mm256_or_si256(
+                _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), inRange32(x, '\t', 4)));
+}
+
+AVX2_FUNC static inline unsigned digitMask32(__m256i x){
+    return _mm256_movemask_epi8(inRange32(x, '0', 9));
+}
+
+AVX2_FUNC static inline unsigned alnumMask32(__m256i x){
+    __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    return _mm256_movemask_epi8(_mm256_or_si256(
+                inRange32(lower, 'a', 25), inRange32(x, '0', 9)));
+}
+
+AVX2_FUNC static inline unsigned newlineMask32(__m256i x){
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+}
+
+AVX2_FUNC static const char *skipSpaceAVX2(const char *cur, const char *end, int &lines){
+    while (end - cur >= 32){
+        __m256i x = _mm256_loadu_si256((const __m256i*)cur);
+        unsigned other = ~spaceMask32(x);
+        unsigned newline = newlineMask32(x);
+        if (other){
+            int n = __builtin_ctz(other);
+            lines += __builtin_popcount(newline & ((1u << n) - 1));
+            return cur + n;
+        }
+        lines += __builtin_popcount(newline);
+        cur += 32;
+    }
+    return skipSpaceSSE2(cur, end, lines);
+}
+
+AVX2_FUNC static const char *skipAlnumAVX2(const char *cur, const char *end){
+    while (end - cur >= 32){
+        unsigned other = ~alnumMask32(_mm256_loadu_si256((const __m256i*)cur));
+        if (other)
+            return cur + __builtin_ctz(other);
+        cur += 32;
+    }
+    return skipAlnumSSE2(cur, end);
+}
+
+AVX2_FUNC static const char *skipDigitAVX2(const char *cur, const char *end){
+    while (end - cur >= 32){
+        unsigned other = ~digitMask32(_mm256_loadu_si256((const __m256i*)cur));
+        if (other)
+            return cur + __builtin_ctz(other);
+        cur += 32;
+    }
+    return skipDigitSSE2(cur, end);
+}
+
+AVX2_FUNC static const char *findCommentEndAVX2(const char *cur, const char *end, int &lines){
+    while (end - cur >= 33){
+        __m256i x0 = _mm256_loadu_si256((const __m256i*)cur);
+        __m256i x1 = _mm256_loadu_si256((const __m256i*)(cur + 1));
+        unsigned found = _mm256_movemask_epi8(_mm256_and_si256(
+                    _mm256_cmpeq_epi8(x0, _mm256_set1_epi8('*')),
+                    _mm256_cmpeq_epi8(x1, _mm256_set1_epi8('/'))));
+        unsigned newline = newlineMask32(x0);
+        if (found){
+            int n = __builtin_ctz(found);
+            lines += __builtin_popcount(newline & ((1u << n) - 1));
+            return cur + n;
+        }
+        lines += __builtin_popcount(newline);
+        cur += 32;
+    }
+    return findCommentEndSSE2(cur, end, lines);
+}
+
+static const Scanner AVX2Scanner = {
+    skipSpaceAVX2,
+    skipAlnumAVX2,
+    skipDigitAVX2,
+    findCommentEndAVX2
+};
+
+#endif
+
+
+/****************************************
+ * Dispatch
+ * *************************************/
+
+static ScanMode CurMode = SCAN_AUTO;
+static const Scanner *CurScanner = NULL;
+
+/**
+ * Whether the CPU can run mode
+ */
+bool isScanModeSupported(ScanMode mode){
+    switch (mode){
+        case SCAN_AUTO:
+        case SCAN_SCALAR:
+            return true;
+#ifdef SCAN_X86
+        case SCAN_SSE2:
+            return true;
+        case SCAN_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+/**
+ * Select the scanner implementation
+ * SCAN_AUTO picks the widest one the CPU supports
+ * @return success: true unsupported: false
+ */
+bool setScanMode(ScanMode mode){
+    if (!isScanModeSupported(mode))
+        return false;
+
+    if (mode == SCAN_AUTO){
+        mode = SCAN_SCALAR;
+        if (isScanModeSupported(SCAN_AVX2))
+            mode = SCAN_AVX2;
+        else if (isScanModeSupported(SCAN_SSE2))
+            mode = SCAN_SSE2;
+    }
+
+    switch (mode){
+#ifdef SCAN_X86
+        case SCAN_SSE2:
+            CurScanner = &SSE2Scanner;
+            break;
+        case SCAN_AVX2:
+            CurScanner = &AVX2Scanner;
+            break;
+#endif
+        default:
+            CurScanner = &ScalarScanner;
+            break;
+    }
+    CurMode = mode;
+    return true;
+}
+
+ScanMode getScanMode(){
+    if (!CurScanner)
+        setScanMode(SCAN_AUTO);
+    return CurMode;
+}
+
+const char *getScanModeName(ScanMode mode){
+    switch (mode){
+        case SCAN_SCALAR:
+            return "scalar";
+        case SCAN_SSE2:
+            return "sse2";
+        case SCAN_AVX2:
+            return "avx2";
+        default:
+            return "auto";
+    }
+}
+
+/**
+ * Get the scanner selected by setScanMode (initially SCAN_AUTO)
+ */
+const Scanner &getScanner(){
+    if (!CurScanner)
+        setScanMode(SCAN_AUTO);
+    return *CurScanner;
+}
@@ -0,0 +1,108 @@
+#include "speculator.hpp"
+
+
+/**
+ * Constructor
+ * @param engine of the lazy JIT, entry function of the program
+ */
+Speculator::Speculator(llvm::ExecutionEngine *engine, const llvm::Function *entry)
+    : Engine(engine), Entry(entry), Stopping(false), CompiledAhead(0), Stalls(0){
+}
+
+/**
+ * Destructor
+ */
+Speculator::~Speculator(){
+    stop();
+}
+
+/**
+ * Add an edge of the static call graph
+ * @return success: true fail: false
+ */
+bool Speculator::addCall(const llvm::Function *caller, llvm::Function *callee){
+    if (callee->isDeclaration())
+        return false;
+    std::lock_guard<std::mutex> guard(Lock);
+    Callees[caller].push_back(callee);
+    return true;
+}
+
+/**
+ * Start the workers; the calling thread is the one running the program
+ * @return success: true fail: false
+ */
+bool Speculator::start(int threads){
+    if (threads < 1 || !Workers.empty())
+        return false;
+    RunThread = std::this_thread::get_id();
+    Engine->RegisterJITEventListener(this);
+    for (int i=0; i<threads; i++)
+        Workers.push_back(std::thread(&Speculator::runWorker, this));
+    return true;
+}
+
+/**
+ * Stop the workers, dropping the functions still queued
+ * @return success: true fail: false
+ */
+bool Speculator::stop(){
+    if (Workers.empty())
+        return false;
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Stopping = true;
+        Queue.clear();
+    }
+    Ready.notify_all();
+    for (int i=0; i<Workers.size(); i++)
+        Workers[i].join();
+    Workers.clear();
+    Engine->UnregisterJITEventListener(this);
+    return true;
+}
+
+/**
+ * Called by the JIT, holding its lock, when func has been compiled:
+ * count who compiled it and queue its callees not compiled yet
+ */
+void Speculator::NotifyFunctionEmitted(const llvm::Function &func, void *code, size_t size,
+        const llvm::JITEventListener::EmittedFunctionDetails &details){
+    std::lock_guard<std::mutex> guard(Lock);
+    Seen.insert(&func);
+    if (std::this_thread::get_id() != RunThread)
+        CompiledAhead++;
+    else if (&func != Entry)
+        Stalls++;
+
+    llvm::DenseMap<const llvm::Function*, std::vector<llvm::Function*> >::iterator callees = Callees.find(&func);
+    if (callees == Callees.end() || Stopping)
+        return;
+    for (int i=0; i<callees->second.size(); i++){
+        llvm::Function *callee = callees->second[i];
+        if (Seen.insert(callee).second)
+            Queue.push_back(callee);
+    }
+    Ready.notify_all();
+}
+
+/**
+ * Worker compiling the queued functions
+ * The lock of the queue is released while compiling, as the JIT calls
+ * NotifyFunctionEmitted from the compiling thread
+ */
+void Speculator::runWorker(){
+    std::unique_lock<std::mutex> guard(Lock);
+    while (true){
+        while (!Stopping && Queue.empty())
+            Ready.wait(guard);
+        if (Stopping)
+            return;
+        llvm::Function *func = Queue.front();
+        Queue.pop_front();
+
+        guard.unlock();
+        Engine->getPointerToFunction(func);
+        guard.lock();
+    }
+}
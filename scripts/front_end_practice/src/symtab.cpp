@@ -0,0 +1,48 @@
+#include "symtab.hpp"
+
+
+/**
+ * Open a scope, declarations made from now on are dropped by popScope
+ * @return true
+ */
+bool SymbolTable::pushScope(){
+    Scopes.push_back(Entries.size());
+    return true;
+}
+
+/**
+ * Close the innermost scope, restoring the declarations it shadowed
+ * @return success: true fail: false (no scope is open)
+ */
+bool SymbolTable::popScope(){
+    if (Scopes.empty())
+        return false;
+
+    int begin = Scopes.back();
+    Scopes.pop_back();
+    for (int i=Entries.size()-1; i>=begin; i--)
+        Index[Entries[i].Name] = Entries[i].Shadowed;
+    Entries.resize(begin);
+    return true;
+}
+
+/**
+ * Declare name in the innermost scope
+ * @param name, declaration (may be NULL if only duplicates are checked)
+ * @return success: true fail: false (name is already declared in this scope or no scope is open)
+ */
+bool SymbolTable::declare(SymbolID name, VariableDeclAST *decl){
+    if (Scopes.empty())
+        return false;
+
+    std::pair<llvm::DenseMap<SymbolID, int>::iterator, bool> res =
+        Index.insert(std::make_pair(name, -1));
+    int &innermost = res.first->second;
+    if (innermost >= Scopes.back())
+        return false;
+
+    Entry entry = {name, decl, innermost};
+    Entries.push_back(entry);
+    innermost = Entries.size() - 1;
+    return true;
+}
@@ -0,0 +1,303 @@
+#include <chrono>
+#include <cstdio>
+#include "tiercompiler.hpp"
+
+
+/**
+ * Constructor
+ * @param TranslationUnitAST loaded by interp, Interpreter, threshold
+ * of interp (for the log)
+ */
+TierCompiler::TierCompiler(TranslationUnitAST &tunit, Interpreter *interp, unsigned threshold)
+    : TU(&tunit), Interp(interp), Threshold(threshold), Engine(NULL), Stopping(false),
+    TierUps(0), NativeFunctions(0){
+    Compiled.assign(interp->getNumFunctions(), false);
+    Code.assign(interp->getNumFunctions(), NULL);
+}
+
+/**
+ * Destructor
+ */
+TierCompiler::~TierCompiler(){
+    stop();
+
+    //The modules stay with their CodeGen
+    for (int i=0; i<Modules.size(); i++){
+        if (Engine)
+            Engine->removeModule(&Modules[i]->getModule());
+        SAFE_DELETE(Modules[i]);
+    }
+    SAFE_DELETE(Engine);
+}
+
+/**
+ * Start the thread compiling the functions handed over
+ * @return success: true fail: false
+ */
+bool TierCompiler::start(){
+    if (Worker.joinable())
+        return false;
+    Worker = std::thread(&TierCompiler::runWorker, this);
+    return true;
+}
+
+/**
+ * Stop the thread after the function being compiled, dropping the
+ * functions still queued
+ * @return success: true fail: false
+ */
+bool TierCompiler::stop(){
+    if (!Worker.joinable())
+        return false;
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Stopping = true;
+        Queue.clear();
+    }
+    Ready.notify_all();
+    Worker.join();
+    return true;
+}
+
+/**
+ * Called by the Interpreter when the calls of func reach the threshold
+ * @return success: true fail: false (stopped)
+ */
+bool TierCompiler::requestTierUp(int func){
+    std::lock_guard<std::mutex> guard(Lock);
+    if (Stopping)
+        return false;
+    Queue.push_back(func);
+    Ready.notify_one();
+    return true;
+}
+
+/**
+ * Thread compiling the queued functions
+ */
+void TierCompiler::runWorker(){
+    std::unique_lock<std::mutex> guard(Lock);
+    while (true){
+        while (!Stopping && Queue.empty())
+            Ready.wait(guard);
+        if (Stopping)
+            return;
+        int func = Queue.front();
+        Queue.pop_front();
+
+        //A function compiled with an earlier group is native already
+        guard.unlock();
+        if (!Compiled[func])
+            compile(func);
+        guard.lock();
+    }
+}
+
+/**
+ * Compile func with the functions it reaches that are not native yet,
+ * then install their code in the Interpreter
+ * @return success: true fail: false (the group stays interpreted)
+ */
+bool TierCompiler::compile(int func){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    StringInterner *symbols = TU->getSymbols();
+
+    std::vector<int> group;
+    std::vector<int> worklist(1, func);
+    std::vector<int> callees;
+    Compiled[func] = true;
+    while (!worklist.empty()){
+        int caller = worklist.back();
+        worklist.pop_back();
+        group.push_back(caller);
+        Interp->getCallees(caller, callees);
+        for (int i=0; i<callees.size(); i++){
+            if (!Compiled[callees[i]]){
+                Compiled[callees[i]] = true;
+                worklist.push_back(callees[i]);
+            }
+        }
+    }
+
+    //Recursion never returns, as DummyC has no branches; interpreted, it
+    //ends at the depth limit instead of overflowing the native stack
+    if (hasRecursion(group)){
+        for (int i=0; i<group.size(); i++)
+            Compiled[group[i]] = false;
+        fprintf(stderr, "tier-up: %s stays interpreted, it reaches recursive calls\n",
+                symbols->getName(TU->getFunction(func)->getName()).c_str());
+        return false;
+    }
+
+    std::vector<FunctionAST*> definitions;
+    for (int i=0; i<group.size(); i++)
+        definitions.push_back(TU->getFunction(group[i]));
+
+    char name[32];
+    snprintf(name, sizeof(name), "tier%zu", Modules.size());
+    CodeGen *codegen = new CodeGen();
+    if (!codegen->doFunctionCodeGen(*TU, definitions, name)){
+        SAFE_DELETE(codegen);
+        for (int i=0; i<group.size(); i++)
+            Compiled[group[i]] = false;
+        fprintf(stderr, "tier-up: %s failed at codegen\n", symbols->getName(TU->getFunction(func)->getName()).c_str());
+        return false;
+    }
+    llvm::Module &mod = codegen->getModule();
+
+    //Entries of the group, builtins and the functions native already;
+    //a function of the program shadows the builtin of the same name
+    llvm::IRBuilder<> builder(llvm::getGlobalContext());
+    std::vector<llvm::Function*> entries;
+    for (int i=0; i<group.size(); i++)
+        entries.push_back(generateEntry(mod.getFunction(symbols->getString(TU->getFunction(group[i])->getName())), builder));
+    std::vector<std::pair<llvm::Function*, void*> > mappings;
+    for (int i=0; TU->getFunction(i); i++){
+        llvm::Function *decl = mod.getFunction(symbols->getString(TU->getFunction(i)->getName()));
+        if (Code[i] && decl->isDeclaration() && !decl->use_empty())
+            mappings.push_back(std::make_pair(decl, Code[i]));
+    }
+    for (int i=0; TU->getPrototype(i); i++){
+        SymbolID proto_name = TU->getPrototype(i)->getName();
+        llvm::Function *decl = mod.getFunction(symbols->getString(proto_name));
+        BuiltinFunction builtin = Interp->getBuiltin(proto_name);
+        if (builtin && Interp->getFunctionIndex(proto_name) < 0 &&
+                decl->isDeclaration() && !decl->use_empty())
+            generateBuiltin(decl, builtin, builder, mappings);
+    }
+
+    Optimizer optimizer;
+    optimizer.setOptLevel(TierOptLevel);
+    optimizer.run(mod);
+
+    //One engine holds the modules of all the groups
+    if (!Engine){
+        std::string error;
+        Engine = llvm::EngineBuilder(&mod)
+            .setEngineKind(llvm::EngineKind::JIT)
+            .setErrorStr(&error)
+            .create();
+        if (!Engine){
+            fprintf(stderr, "tier-up: %s\n", error.c_str());
+            SAFE_DELETE(codegen);
+            for (int i=0; i<group.size(); i++)
+                Compiled[group[i]] = false;
+            return false;
+        }
+        Engine->DisableLazyCompilation(true);
+    }else{
+        Engine->addModule(&mod);
+    }
+    Modules.push_back(codegen);
+    for (int i=0; i<mappings.size(); i++)
+        Engine->addGlobalMapping(mappings[i].first, mappings[i].second);
+
+    std::vector<NativeFunction> natives;
+    for (int i=0; i<group.size(); i++){
+        Code[group[i]] = Engine->getPointerToFunction(
+                mod.getFunction(symbols->getString(TU->getFunction(group[i])->getName())));
+        natives.push_back((NativeFunction)Engine->getPointerToFunction(entries[i]));
+    }
+
+    //Installed once the whole group is compiled
+    for (int i=0; i<group.size(); i++)
+        Interp->setNative(group[i], natives[i]);
+    TierUps++;
+    NativeFunctions += group.size();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    fprintf(stderr, "tier-up: %s after %u calls, %zu functions native in %.3f ms\n",
+            symbols->getName(TU->getFunction(func)->getName()).c_str(), Threshold,
+            group.size(), elapsed.count() * 1e3);
+    return true;
+}
+
+/**
+ * Whether the calls among the functions of group have a cycle
+ * Functions without callers in the group are removed until none is left
+ * (Kahn's algorithm); the functions left are on or below a cycle
+ * @return cycle: true none: false
+ */
+bool TierCompiler::hasRecursion(const std::vector<int> &group){
+    std::vector<int> position(Interp->getNumFunctions(), -1);
+    for (int i=0; i<group.size(); i++)
+        position[group[i]] = i;
+
+    std::vector<std::vector<int> > callees(group.size());
+    std::vector<int> num_callers(group.size(), 0);
+    for (int i=0; i<group.size(); i++){
+        Interp->getCallees(group[i], callees[i]);
+        for (int j=0; j<callees[i].size(); j++){
+            if (position[callees[i][j]] >= 0)
+                num_callers[position[callees[i][j]]]++;
+        }
+    }
+
+    std::vector<int> worklist;
+    for (int i=0; i<group.size(); i++){
+        if (num_callers[i] == 0)
+            worklist.push_back(i);
+    }
+    int removed = 0;
+    while (!worklist.empty()){
+        int caller = worklist.back();
+        worklist.pop_back();
+        removed++;
+        for (int j=0; j<callees[caller].size(); j++){
+            int callee = position[callees[caller][j]];
+            if (callee >= 0 && --num_callers[callee] == 0)
+                worklist.push_back(callee);
+        }
+    }
+    return removed < group.size();
+}
+
+/**
+ * Generate "name.tier" calling func with the arguments of an array
+ * @return entry Function
+ */
+llvm::Function *TierCompiler::generateEntry(llvm::Function *func, llvm::IRBuilder<> &builder){
+    llvm::Type *int_type = llvm::Type::getInt32Ty(llvm::getGlobalContext());
+    llvm::FunctionType *entry_type = llvm::FunctionType::get(int_type,
+            llvm::PointerType::getUnqual(int_type), false);
+    llvm::Function *entry = llvm::Function::Create(entry_type,
+            llvm::Function::ExternalLinkage, func->getName() + ".tier", func->getParent());
+    builder.SetInsertPoint(llvm::BasicBlock::Create(llvm::getGlobalContext(), "entry", entry));
+
+    llvm::Value *args = entry->arg_begin();
+    std::vector<llvm::Value*> values;
+    for (int i=0; i<func->arg_size(); i++)
+        values.push_back(builder.CreateLoad(builder.CreateConstGEP1_32(args, i)));
+    builder.CreateRet(builder.CreateCall(func, values));
+    return entry;
+}
+
+/**
+ * Define the declaration func as a call of builtin through
+ * "name.builtin", whose mapping is added to mappings
+ * @return success: true fail: false
+ */
+bool TierCompiler::generateBuiltin(llvm::Function *func, BuiltinFunction builtin,
+        llvm::IRBuilder<> &builder, std::vector<std::pair<llvm::Function*, void*> > &mappings){
+    llvm::Type *int_type = llvm::Type::getInt32Ty(llvm::getGlobalContext());
+    std::vector<llvm::Type*> param_types;
+    param_types.push_back(llvm::PointerType::getUnqual(int_type));
+    param_types.push_back(int_type);
+    llvm::Function *decl = llvm::Function::Create(
+            llvm::FunctionType::get(int_type, param_types, false),
+            llvm::Function::ExternalLinkage, func->getName() + ".builtin", func->getParent());
+    builder.SetInsertPoint(llvm::BasicBlock::Create(llvm::getGlobalContext(), "entry", func));
+
+    int num_args = func->arg_size();
+    llvm::Value *args = builder.CreateAlloca(int_type, builder.getInt32(num_args > 0 ? num_args : 1), "args");
+    llvm::Function::arg_iterator arg = func->arg_begin();
+    for (int i=0; i<num_args; i++, ++arg)
+        builder.CreateStore(arg, builder.CreateConstGEP1_32(args, i));
+    std::vector<llvm::Value*> values;
+    values.push_back(args);
+    values.push_back(builder.getInt32(num_args));
+    builder.CreateRet(builder.CreateCall(decl, values));
+
+    mappings.push_back(std::make_pair(decl, (void*)builtin));
+    return true;
+}